@@ -12,17 +12,35 @@
 #include <map>
 #include <stack>
 #include <set>
+#include <queue>
+#include <vector>
+#include <functional>
 #include <pthread.h>
 #include "trace_format.h"
+#include "trace_codec.h"
 
 using trace = trace_format;
 static UINT64 totalInst = 0;
-UINT64 totalROI = 0;
 bool gotROI = false;
-std::ofstream traceFile;
-PIN_LOCK pinLock;
-std::map<THREADID, std::stack<double>> threadRegionID;
-std::set<THREADID> activeThreads;
+PIN_LOCK pinLock;            // only guards thread registration, never the traced instructions.
+TLS_KEY traceKey;
+UINT64 traceSequence = 0;    // global record order, stamped into the per-thread parts of a merged trace.
+
+/* per-thread trace state kept in Pin TLS, so tracing an instruction takes no process-wide lock */
+struct ThreadTrace {
+    THREADID threadID;
+    FILE* file = NULL;
+    std::string fileName;
+    std::vector<uint8_t> buffer;             // records are flushed to file in large blocks.
+    size_t length = 0;
+    trace_codec::Encoder encoder;            // per-thread output only.
+    trace_codec::SummaryCounter counter;     // per-thread output only.
+    std::stack<UINT64> regionID;             // open regions of the thread.
+    UINT64 totalROI = 0;
+    bool closed = false;
+};
+std::vector<ThreadTrace*> threadTraces;    // one per registration, or per THREADID with -t.
+const size_t THREAD_BUFFER_SIZE = 4 << 20;
 
 /* ===================================================================== */
 // Command line switches
@@ -34,25 +52,88 @@ KNOB<UINT64> KnobSkipInstructions(KNOB_MODE_WRITEONCE, "pintool", "s", "0", "How
 KNOB<UINT64> KnobTraceInstructions(KNOB_MODE_WRITEONCE, "pintool", "e", "10000000", "How many instructions to trace");
 
 KNOB<UINT64> KnobProcessID(KNOB_MODE_WRITEONCE, "pintool", "p", "1", "What will be the process id");
+
+KNOB<UINT32> KnobTraceFormat(KNOB_MODE_WRITEONCE, "pintool", "f", "2", "Trace format version (1: raw records, 2: compact)");
+
+KNOB<BOOL> KnobPerThread(KNOB_MODE_WRITEONCE, "pintool", "t", "0", "Write one trace per thread (<output>.<thread id>) instead of a merged trace");
 /* ===================================================================== */
 
+/* a merged trace is written as sequence-stamped raw parts, merged at the end.
+   Parts are named by registration, Pin may hand a THREADID to a later thread again. */
+std::string PartFileName(size_t registration) {
+    return KnobOutputFile.Value() + ".part." + std::to_string(registration);
+}
+
+void FlushThreadTrace(ThreadTrace* t) {
+    if (t->length != 0)
+        fwrite(t->buffer.data(), 1, t->length, t->file);
+    t->length = 0;
+}
+
+void CloseThreadTrace(ThreadTrace* t) {
+    if (t->closed)
+        return;
+    FlushThreadTrace(t);
+    if (KnobPerThread.Value() && KnobTraceFormat.Value() != TRACE_FORMAT_V1)
+        trace_codec::rewrite_header(t->file, TRACE_FORMAT_V2, t->counter.summary);
+    fclose(t->file);
+    t->closed = true;
+}
+
 void OnThreadStart(THREADID tid, CONTEXT* ctxt, INT32 flags, VOID* v) {
-    activeThreads.insert(tid);
+    ThreadTrace* t = NULL;
+    size_t registration = 0;
+    PIN_GetLock(&pinLock, tid);
+    // a per-thread trace of a reused THREADID is continued, the file and its encoder state belong to the ID.
+    for (size_t i = 0; KnobPerThread.Value() && i < threadTraces.size() && t == NULL; i++)
+        if (threadTraces[i]->threadID == tid)
+            t = threadTraces[i];
+    bool reused = t != NULL;
+    if (!reused) {
+        t = new ThreadTrace();
+        registration = threadTraces.size();
+        threadTraces.push_back(t);
+    }
+    PIN_ReleaseLock(&pinLock);
+
+    if (!reused) {
+        t->threadID = tid;
+        t->buffer.resize(THREAD_BUFFER_SIZE);
+        t->fileName = KnobPerThread.Value() ? KnobOutputFile.Value() + "." + std::to_string(tid) : PartFileName(registration);
+        t->file = fopen(t->fileName.c_str(), "wb");
+    }
+    else {
+        CloseThreadTrace(t);
+        t->file = fopen(t->fileName.c_str(), "r+b");
+        if (t->file != NULL)
+            fseeko(t->file, 0, SEEK_END);
+        t->closed = false;
+        t->regionID = std::stack<UINT64>();
+    }
+    if (t->file == NULL) {
+        std::cerr << "Can not open " << t->fileName << std::endl;
+        PIN_ExitProcess(1);
+    }
+    t->regionID.push(0);
+    if (KnobPerThread.Value() && KnobTraceFormat.Value() != TRACE_FORMAT_V1 && ftello(t->file) == 0)
+        t->length = trace_codec::write_header(t->buffer.data(), TRACE_FORMAT_V2, t->counter.summary);
+    PIN_SetThreadData(traceKey, t, tid);
     std::cerr << "Thread " << tid << " started." << std::endl;
 }
 
 void OnThreadExit(THREADID tid, const CONTEXT* ctxt, INT32 flags, VOID* v) {
-    activeThreads.erase(tid);
+    CloseThreadTrace(static_cast<ThreadTrace*>(PIN_GetThreadData(traceKey, tid)));
     std::cerr << "Thread " << tid << " exited." << std::endl;
 }
 
 VOID StoreInstructionInfo(THREADID threadID, ADDRINT ip, const char* opcode, UINT64 tag, UINT64 regionID,
                        UINT64* readAddrs, UINT64* writeAddrs) {
-    PIN_GetLock(&pinLock, threadID);
+    ThreadTrace* t = static_cast<ThreadTrace*>(PIN_GetThreadData(traceKey, threadID));
+    std::stack<UINT64>& threadRegionID = t->regionID;
     trace trace_data;
 
     if (tag == 1031) {
-        ++totalROI;
+        ++t->totalROI;
         // trace_data.processID = PIN_GetPid()%4 + 1;
         trace_data.processID = KnobProcessID.Value();
         trace_data.threadID = threadID;
@@ -70,7 +151,7 @@ VOID StoreInstructionInfo(THREADID threadID, ADDRINT ip, const char* opcode, UIN
         }
 
         trace_data.regionID = regionID;
-        threadRegionID[threadID].push(regionID);
+        threadRegionID.push(regionID);
     }
     else if (tag == 1032) {
         trace_data.processID = KnobProcessID.Value();
@@ -89,8 +170,8 @@ VOID StoreInstructionInfo(THREADID threadID, ADDRINT ip, const char* opcode, UIN
         }
 
         trace_data.regionID = regionID;
-        if (threadRegionID[threadID].top() == regionID)
-            threadRegionID[threadID].pop();
+        if (threadRegionID.top() == regionID)
+            threadRegionID.pop();
     }
     else {
         trace_data.processID = KnobProcessID.Value();
@@ -109,12 +190,26 @@ VOID StoreInstructionInfo(THREADID threadID, ADDRINT ip, const char* opcode, UIN
         for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
             trace_data.destAddr[i] = writeAddrs[i];
         }
-        trace_data.regionID = threadRegionID[threadID].top();
+        trace_data.regionID = threadRegionID.top();
     }
 
-    typename decltype(traceFile)::char_type buf[sizeof(trace)];
-    std::memcpy(buf, &trace_data, sizeof(trace));
-    traceFile.write(buf, sizeof(trace));
+    if (t->length + sizeof(UINT64) + sizeof(trace) + TRACE_V2_MAX_RECORD_SIZE > t->buffer.size())
+        FlushThreadTrace(t);
+    if (!KnobPerThread.Value()) {
+        // the part keeps raw records, their global order is restored (and encoded) by MergeThreadTraces.
+        UINT64 sequence = __sync_fetch_and_add(&traceSequence, 1);
+        std::memcpy(t->buffer.data() + t->length, &sequence, sizeof(sequence));
+        std::memcpy(t->buffer.data() + t->length + sizeof(sequence), &trace_data, sizeof(trace));
+        t->length += sizeof(sequence) + sizeof(trace);
+    }
+    else if (KnobTraceFormat.Value() == TRACE_FORMAT_V1) {
+        std::memcpy(t->buffer.data() + t->length, &trace_data, sizeof(trace));
+        t->length += sizeof(trace);
+    }
+    else {
+        t->length += t->encoder.encode(trace_data, t->buffer.data() + t->length);
+        t->counter.add(trace_data);
+    }
 
     // If you wnat to print the traces
     // std::cout << trace_data.processID << " " << trace_data.threadID << " " << trace_data.instPointer << " " << trace_data.opcode << " " ;
@@ -125,8 +220,6 @@ VOID StoreInstructionInfo(THREADID threadID, ADDRINT ip, const char* opcode, UIN
     //     if (trace_data.destAddr[i] != 0) std::cout << trace_data.destAddr[i] << " ";
     // }
     // std::cout << trace_data.regionID << std::endl;
-
-    PIN_ReleaseLock(&pinLock);
 }
 
 BOOL ShouldWrite() {
@@ -216,8 +309,79 @@ VOID Instruction(INS ins, VOID* v) {
     }
 }
 
+/* k-way merge of the sequence-stamped parts into the single output trace */
+void MergeThreadTraces() {
+    struct Part {
+        FILE* file;
+        UINT64 sequence;
+        trace record;
+    };
+    std::vector<Part> parts;
+    auto advance = [](Part& part) {
+        return fread(&part.sequence, sizeof(part.sequence), 1, part.file) == 1
+            && fread(&part.record, sizeof(part.record), 1, part.file) == 1;
+    };
+    typedef std::pair<UINT64, size_t> Head;    // (sequence, part)
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (ThreadTrace* t : threadTraces) {
+        Part part = {fopen(t->fileName.c_str(), "rb"), 0, trace()};
+        if (part.file == NULL)
+            continue;
+        setvbuf(part.file, NULL, _IOFBF, THREAD_BUFFER_SIZE);
+        parts.push_back(part);
+        if (advance(parts.back()))
+            heads.push(Head(parts.back().sequence, parts.size() - 1));
+    }
+
+    FILE* out = fopen(KnobOutputFile.Value().c_str(), "wb");
+    if (out == NULL) {
+        std::cerr << "Can not open " << KnobOutputFile.Value() << std::endl;
+        return;
+    }
+    std::vector<uint8_t> buffer(THREAD_BUFFER_SIZE);
+    size_t length = 0;
+    trace_codec::Encoder encoder;
+    trace_codec::SummaryCounter counter;    // the summary is filled in once every record is written.
+    if (KnobTraceFormat.Value() != TRACE_FORMAT_V1)
+        length = trace_codec::write_header(buffer.data(), TRACE_FORMAT_V2, counter.summary);
+    while (!heads.empty()) {
+        Part& part = parts[heads.top().second];
+        heads.pop();
+        if (length + sizeof(trace) + TRACE_V2_MAX_RECORD_SIZE > buffer.size()) {
+            fwrite(buffer.data(), 1, length, out);
+            length = 0;
+        }
+        if (KnobTraceFormat.Value() == TRACE_FORMAT_V1) {
+            std::memcpy(buffer.data() + length, &part.record, sizeof(trace));
+            length += sizeof(trace);
+        }
+        else {
+            length += encoder.encode(part.record, buffer.data() + length);
+            counter.add(part.record);
+        }
+        if (advance(part))
+            heads.push(Head(part.sequence, &part - &parts[0]));
+    }
+    fwrite(buffer.data(), 1, length, out);
+    if (KnobTraceFormat.Value() != TRACE_FORMAT_V1)
+        trace_codec::rewrite_header(out, TRACE_FORMAT_V2, counter.summary);
+    fclose(out);
+
+    for (size_t i = 0; i < parts.size(); i++)
+        fclose(parts[i].file);
+    for (ThreadTrace* t : threadTraces)
+        unlink(t->fileName.c_str());
+}
+
 VOID Fini(INT32 code, VOID* v) {
-    traceFile.close();
+    UINT64 totalROI = 0;
+    for (ThreadTrace* t : threadTraces) {
+        CloseThreadTrace(t);
+        totalROI += t->totalROI;
+    }
+    if (!KnobPerThread.Value())
+        MergeThreadTraces();
+
     std::cerr << "Total " << totalInst << " instruction Exist.\n";
     std::cerr << "Total " << totalROI << " ROI Exist.\n";
     std::cerr << "Limit Given " << KnobTraceInstructions.Value() << " instruction\n";
@@ -229,13 +393,8 @@ int main(int argc, char* argv[]) {
         return 1;
     } 
 
-    for(int threadIndex=0; threadIndex<32; threadIndex++)
-        threadRegionID[threadIndex].push(0); //threadRegionID[threadIndex] = 0;
-
     PIN_InitLock(&pinLock);
-
-    traceFile.open(KnobOutputFile.Value().c_str());
-    traceFile << std::setfill(' ');
+    traceKey = PIN_CreateThreadDataKey(NULL);
 
     PIN_AddThreadStartFunction(OnThreadStart, nullptr);
     PIN_AddThreadFiniFunction(OnThreadExit, nullptr);
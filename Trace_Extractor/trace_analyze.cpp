@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "trace_io.h"
+#include "Config.h"
+#include "HMC.h"
+
+/*
+ * Offline locality profile of an MCPSim trace, per regionID and per thread.
+ *   trace_analyze [-c <config>] [-j <threads>] [-o <output json>] <input trace>
+ * For every region it reports the instruction count and memory-instruction ratio, the unique 64B-line and 4KB-page
+ * footprint, the LRU reuse-distance histogram (in lines, over the access stream of each thread) and the share of
+ * accesses per HMC vault under the default address mapping of the config (org, maxblock, stacks), applied to the
+ * trace addresses as they are (i.e. translation = None).
+ * The output borrows the layout of the compiler's proc_<pid>_bb_info.json, one "trace_profile" function whose basic
+ * blocks are the regions, with dynamic counts and without the static ones the trace does not carry (arithmetic
+ * instructions). It defaults to proc_<processID>_trace_profile.json in the working directory.
+ * v3 chunks are inflated and decoded on all threads; v1/v2 traces are decoded sequentially. The profiles are then
+ * built on all threads, every thread owning the trace threads with threadID % threads equal to its number.
+ */
+
+using namespace std;
+using namespace ramulator;
+
+const int LINE_BITS = 6;
+const int PAGE_BITS = 12;
+const int REUSE_BUCKETS = 40;       // bucket 0 is distance 0, bucket i holds [2^(i-1), 2^i) lines.
+
+/* compact decoded record, the addresses live in the chunk's address array */
+struct analyze_record
+{
+    uint64_t regionID;
+    uint32_t threadID;
+    uint16_t addr_count;
+    uint16_t is_marker;
+};
+
+struct decoded_chunk
+{
+    vector<analyze_record> records;
+    vector<uint64_t> addrs;
+
+    void add(const trace_format& line)
+    {
+        analyze_record record;
+        record.regionID = line.regionID;
+        record.threadID = line.threadID;
+        record.addr_count = 0;
+        record.is_marker = strcmp(line.opcode, "ROI_BEGIN") == 0 || strcmp(line.opcode, "ROI_END") == 0;
+        for (int i = 0; i < NUM_INSTR_SOURCES; i++)
+            if (line.sourceAddr[i] != 0) {
+                addrs.push_back(line.sourceAddr[i]);
+                ++record.addr_count;
+            }
+        for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++)
+            if (line.destAddr[i] != 0) {
+                addrs.push_back(line.destAddr[i]);
+                ++record.addr_count;
+            }
+        records.push_back(record);
+    }
+
+    void clear()
+    {
+        records.clear();
+        addrs.clear();
+    }
+};
+
+/* default HMC address mapping, as in Memory<HMC>::send and Core::get_vault_target */
+struct VaultMapping
+{
+    uint64_t address_mask;
+    int low_bits;       // transaction and max block column bits, below the vault bits.
+    int vault_bits;
+
+    VaultMapping(const Config& configs)
+    {
+        HMC spec(configs["org"], configs["speed"], configs["maxblock"], configs["link_width"], configs["lane_speed"],
+                 configs.get_int_value("source_mode_host_links"), configs.get_int_value("payload_flits"));
+        uint64_t max_address = spec.channel_width / 8;
+        for (int lev = 0; lev < int(HMC::Level::MAX); lev++)
+            max_address *= spec.org_entry.count[lev];
+        address_mask = max_address * configs.get_stacks() - 1;
+        low_bits = spec.maxblock_entry.flit_num_bits;
+        vault_bits = calc_log2(spec.org_entry.count[int(HMC::Level::Vault)]);
+    }
+
+    int vaults() const { return 1 << vault_bits; }
+    int vault(uint64_t addr) const { return ((addr & address_mask) >> low_bits) & ((1 << vault_bits) - 1); }
+
+private:
+    static int calc_log2(uint64_t val)
+    {
+        int n = 0;
+        while ((val >>= 1))
+            n++;
+        return n;
+    }
+};
+
+/* locality profile of one region of one thread (or of every thread of a region, once merged) */
+struct RegionProfile
+{
+    uint64_t instructions = 0;
+    uint64_t memory_instructions = 0;
+    uint64_t accesses = 0;
+    uint64_t cold_accesses = 0;
+    vector<uint64_t> reuse;
+    vector<uint64_t> vault_accesses;
+    unordered_set<uint64_t> lines, pages;
+
+    RegionProfile(int vaults = 0) : reuse(REUSE_BUCKETS, 0), vault_accesses(vaults, 0) {}
+
+    void merge(const RegionProfile& other)
+    {
+        instructions += other.instructions;
+        memory_instructions += other.memory_instructions;
+        accesses += other.accesses;
+        cold_accesses += other.cold_accesses;
+        for (int i = 0; i < REUSE_BUCKETS; i++)
+            reuse[i] += other.reuse[i];
+        for (size_t i = 0; i < vault_accesses.size(); i++)
+            vault_accesses[i] += other.vault_accesses[i];
+        lines.insert(other.lines.begin(), other.lines.end());
+        pages.insert(other.pages.begin(), other.pages.end());
+    }
+};
+
+/*
+ * exact LRU stack distance of a line access stream: a Fenwick tree over access times marks the latest access of every
+ * line, the distance of a reuse is the number of marks after the line's previous access. The times are renumbered
+ * when the tree fills up, so it stays proportional to the number of distinct lines.
+ */
+class ReuseTracker
+{
+public:
+    ReuseTracker() : tree(1 << 16, 0) {}
+
+    /* returns the distance in distinct lines, or -1 on the first access of the line */
+    int64_t access(uint64_t line)
+    {
+        if (now + 1 >= tree.size())
+            compact();
+        int64_t distance = -1;
+        auto it = last.find(line);
+        if (it != last.end()) {
+            distance = live - prefix(it->second);
+            update(it->second, -1);
+            it->second = now;
+        }
+        else {
+            last[line] = now;
+            ++live;
+        }
+        update(now++, 1);
+        return distance;
+    }
+
+private:
+    vector<int64_t> tree;       // 1-based Fenwick tree over the times.
+    unordered_map<uint64_t, uint64_t> last;
+    uint64_t now = 0;
+    int64_t live = 0;
+
+    void update(uint64_t time, int64_t delta)
+    {
+        for (uint64_t i = time + 1; i < tree.size(); i += i & (0 - i))
+            tree[i] += delta;
+    }
+
+    int64_t prefix(uint64_t time) const
+    {
+        int64_t sum = 0;
+        for (uint64_t i = time + 1; i > 0; i -= i & (0 - i))
+            sum += tree[i];
+        return sum;
+    }
+
+    void compact()
+    {
+        vector<pair<uint64_t, uint64_t>> order;
+        order.reserve(last.size());
+        for (auto& entry : last)
+            order.push_back(make_pair(entry.second, entry.first));
+        sort(order.begin(), order.end());
+        size_t size = tree.size();
+        while (size < 4 * order.size())
+            size *= 2;
+        tree.assign(size, 0);
+        now = 0;
+        for (auto& entry : order) {
+            last[entry.second] = now;
+            update(now++, 1);
+        }
+    }
+};
+
+/* the profiles of the trace threads owned by one analysis thread */
+struct ThreadProfiles
+{
+    map<uint64_t, map<uint32_t, RegionProfile>> regions;    // regionID -> threadID -> profile.
+    unordered_map<uint32_t, ReuseTracker> reuse;
+};
+
+static int reuse_bucket(int64_t distance)
+{
+    int bucket = 0;
+    while (distance > 0 && bucket < REUSE_BUCKETS - 1) {
+        distance >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void profile_chunk(const decoded_chunk& chunk, int owner, int threads, const VaultMapping& mapping, ThreadProfiles& profiles)
+{
+    const uint64_t* addr = chunk.addrs.data();
+    for (const analyze_record& record : chunk.records) {
+        const uint64_t* record_addrs = addr;
+        addr += record.addr_count;
+        if (record.is_marker || int(record.threadID % threads) != owner)
+            continue;
+        map<uint32_t, RegionProfile>& region = profiles.regions[record.regionID];
+        auto it = region.find(record.threadID);
+        if (it == region.end())
+            it = region.emplace(record.threadID, RegionProfile(mapping.vaults())).first;
+        RegionProfile& profile = it->second;
+        ReuseTracker& reuse = profiles.reuse[record.threadID];
+        ++profile.instructions;
+        if (record.addr_count != 0)
+            ++profile.memory_instructions;
+        for (int i = 0; i < record.addr_count; i++) {
+            uint64_t line = record_addrs[i] >> LINE_BITS;
+            int64_t distance = reuse.access(line);
+            if (distance < 0)
+                ++profile.cold_accesses;
+            else
+                ++profile.reuse[reuse_bucket(distance)];
+            ++profile.accesses;
+            ++profile.vault_accesses[mapping.vault(record_addrs[i])];
+            profile.lines.insert(line);
+            profile.pages.insert(record_addrs[i] >> PAGE_BITS);
+        }
+    }
+}
+
+/* decode v3 chunks [first, last) of the index into the batch, one chunk per worker at a time */
+static bool decode_chunks(const char* path, const trace_codec::ContainerIndex& index, size_t first, size_t last,
+                          vector<decoded_chunk>& batch, int threads)
+{
+    vector<char> failed(threads, 0);
+    vector<thread> workers;
+    for (int w = 0; w < threads; w++)
+        workers.push_back(thread([&, w]() {
+            FILE* in = fopen(path, "rb");
+            if (in == NULL) {
+                failed[w] = 1;
+                return;
+            }
+            vector<uint8_t> compressed, raw;
+            for (size_t c = first + w; c < last; c += threads) {
+                const trace_chunk_entry& entry = index.chunks[c];
+                decoded_chunk& chunk = batch[c - first];
+                chunk.clear();
+                compressed.resize(entry.compressed_size);
+                if (fseeko(in, entry.offset, SEEK_SET) != 0 || fread(compressed.data(), 1, compressed.size(), in) != compressed.size()
+                    || !trace_codec::inflate_chunk(compressed.data(), entry, raw)) {
+                    failed[w] = 1;
+                    break;
+                }
+                trace_codec::Decoder decoder;
+                trace_format line;
+                size_t pos = 0, used;
+                while (pos < raw.size() && (used = decoder.decode(raw.data() + pos, raw.size() - pos, line)) != 0) {
+                    chunk.add(line);
+                    pos += used;
+                }
+            }
+            fclose(in);
+        }));
+    for (auto& worker : workers)
+        worker.join();
+    return find(failed.begin(), failed.end(), 1) == failed.end();
+}
+
+static void profile_batch(const vector<decoded_chunk>& batch, size_t count, const VaultMapping& mapping, vector<ThreadProfiles>& profiles)
+{
+    int threads = profiles.size();
+    vector<thread> workers;
+    for (int w = 0; w < threads; w++)
+        workers.push_back(thread([&, w]() {
+            for (size_t c = 0; c < count; c++)
+                profile_chunk(batch[c], w, threads, mapping, profiles[w]);
+        }));
+    for (auto& worker : workers)
+        worker.join();
+}
+
+static void write_profile(ostream& out, const RegionProfile& profile, const string& indent)
+{
+    out << indent << "\"TotalInstructions\": " << profile.instructions << ",\n"
+        << indent << "\"MemoryInstructions\": " << profile.memory_instructions << ",\n"
+        << indent << "\"NonMemoryInstructions\": " << profile.instructions - profile.memory_instructions << ",\n"
+        << indent << "\"TotalMemoryConsumption\": " << (uint64_t(profile.lines.size()) << LINE_BITS) << ",\n"
+        << indent << "\"MemoryInstructionRatio\": " << (profile.instructions ? double(profile.memory_instructions) / profile.instructions : 0.0) << ",\n"
+        << indent << "\"Accesses\": " << profile.accesses << ",\n"
+        << indent << "\"UniqueLines\": " << profile.lines.size() << ",\n"
+        << indent << "\"UniquePages\": " << profile.pages.size() << ",\n"
+        << indent << "\"ColdAccesses\": " << profile.cold_accesses << ",\n"
+        << indent << "\"ReuseDistanceHistogram\": [";
+    int used = REUSE_BUCKETS;
+    while (used > 1 && profile.reuse[used - 1] == 0)
+        --used;
+    for (int i = 0; i < used; i++)
+        out << (i ? ", " : "") << profile.reuse[i];
+    out << "],\n" << indent << "\"VaultShares\": [";
+    for (size_t v = 0; v < profile.vault_accesses.size(); v++)
+        out << (v ? ", " : "") << (profile.accesses ? double(profile.vault_accesses[v]) / profile.accesses : 0.0);
+    out << "]";
+}
+
+int main(int argc, char* argv[])
+{
+    string config_path = "Configs/sample.cfg";
+    string out_path;
+    int threads = max(1u, thread::hardware_concurrency());
+    int arg = 1;
+    while (argc - arg > 1 && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-c") == 0) config_path = argv[arg + 1];
+        else if (strcmp(argv[arg], "-j") == 0) threads = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-o") == 0) out_path = argv[arg + 1];
+        else break;
+        arg += 2;
+    }
+    if (argc - arg != 1 || threads < 1) {
+        cerr << "usage: " << argv[0] << " [-c <config>] [-j <threads>] [-o <output json>] <input trace>" << endl;
+        return 1;
+    }
+
+    if (!ifstream(config_path).good()) {
+        cerr << "Can not open " << config_path << endl;
+        return 1;
+    }
+    Config configs(config_path);
+    VaultMapping mapping(configs);
+
+    const char* path = argv[arg];
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        cerr << "Can not open " << path << endl;
+        return 1;
+    }
+    trace_codec::Reader reader(in);
+    if (reader.version < TRACE_FORMAT_V1 || reader.version > TRACE_FORMAT_V3) {
+        cerr << "Unsupported or damaged trace (format version " << reader.version << ")" << endl;
+        return 1;
+    }
+
+    vector<ThreadProfiles> profiles(threads);
+    vector<decoded_chunk> batch(threads);
+    uint64_t processID = reader.has_summary ? reader.summary.processID : 0;
+    bool first_record = !reader.has_summary;
+    unsigned long long records = 0;
+
+    if (reader.version == TRACE_FORMAT_V3) {
+        trace_codec::ContainerIndex index;
+        if (!index.load(in)) {
+            cerr << "Damaged trace index" << endl;
+            return 1;
+        }
+        for (size_t first = 0; first < index.chunks.size(); first += threads) {
+            size_t last = min(index.chunks.size(), first + threads);
+            if (!decode_chunks(path, index, first, last, batch, threads)) {
+                cerr << "Damaged trace chunk in " << first << ".." << last - 1 << endl;
+                return 1;
+            }
+            profile_batch(batch, last - first, mapping, profiles);
+            for (size_t c = first; c < last; c++)
+                records += index.chunks[c].record_count;
+        }
+        if (first_record && !index.chunks.empty()) {
+            // the processID of a summary-less trace comes from its first record.
+            vector<uint8_t> compressed(index.chunks[0].compressed_size), raw;
+            trace_codec::Decoder decoder;
+            trace_format line;
+            if (fseeko(in, index.chunks[0].offset, SEEK_SET) == 0 && fread(compressed.data(), 1, compressed.size(), in) == compressed.size()
+                && trace_codec::inflate_chunk(compressed.data(), index.chunks[0], raw) && decoder.decode(raw.data(), raw.size(), line) != 0)
+                processID = line.processID;
+        }
+    }
+    else {
+        trace_format line;
+        bool more = true;
+        while (more) {
+            size_t count = 0;
+            for (; count < batch.size() && more; count++) {
+                batch[count].clear();
+                for (uint32_t r = 0; r < TRACE_CHUNK_RECORDS && (more = reader.next(line)); r++) {
+                    if (first_record) {
+                        processID = line.processID;
+                        first_record = false;
+                    }
+                    batch[count].add(line);
+                    ++records;
+                }
+            }
+            profile_batch(batch, count, mapping, profiles);
+        }
+        if (reader.truncated())
+            cerr << "Warning: the trailing bytes of a truncated record are dropped." << endl;
+    }
+    fclose(in);
+
+    // every (region, thread) profile is owned by exactly one analysis thread, only the region totals need merging.
+    map<uint64_t, map<uint32_t, RegionProfile*>> regions;
+    for (auto& owned : profiles)
+        for (auto& region : owned.regions)
+            for (auto& thread_profile : region.second)
+                regions[region.first][thread_profile.first] = &thread_profile.second;
+
+    if (out_path.empty())
+        out_path = "proc_" + to_string(processID) + "_trace_profile.json";
+    ofstream out(out_path);
+    if (!out.is_open()) {
+        cerr << "Can not open " << out_path << endl;
+        return 1;
+    }
+    out << "[\n    {\n        \"FunctionName\": \"trace_profile\",\n        \"Vaults\": " << mapping.vaults()
+        << ",\n        \"BasicBlocks\": [";
+    bool first_region = true;
+    for (auto& region : regions) {
+        RegionProfile total(mapping.vaults());
+        for (auto& thread_profile : region.second)
+            total.merge(*thread_profile.second);
+        out << (first_region ? "\n" : ",\n") << "            {\n"
+            << "                \"BasicBlockID\": " << region.first << ",\n"
+            << "                \"BasicBlockName\": \"region_" << region.first << "\",\n";
+        write_profile(out, total, "                ");
+        out << ",\n                \"Threads\": [";
+        bool first_thread = true;
+        for (auto& thread_profile : region.second) {
+            out << (first_thread ? "\n" : ",\n") << "                    {\n"
+                << "                        \"ThreadID\": " << thread_profile.first << ",\n";
+            write_profile(out, *thread_profile.second, "                        ");
+            out << "\n                    }";
+            first_thread = false;
+        }
+        out << "\n                ]\n            }";
+        first_region = false;
+    }
+    out << "\n        ]\n    }\n]\n";
+    out.close();
+
+    cerr << "Analyzed " << records << " records of process " << processID << " into " << regions.size()
+         << " regions (" << threads << " threads) -> " << out_path << endl;
+    return 0;
+}
@@ -0,0 +1,324 @@
+#ifndef TRACE_CODEC_H
+#define TRACE_CODEC_H
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "trace_format.h"
+
+/* encoder/decoder of the compact v2 trace records, shared by the tracer, the simulator and the converter */
+
+namespace trace_codec
+{
+
+inline size_t put_varint(uint8_t* buf, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = uint8_t(value);
+    return n;
+}
+
+/* returns the number of bytes read, or 0 when the varint runs past end */
+inline size_t get_varint(const uint8_t* buf, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (size_t n = 0, shift = 0; buf + n < end && shift < 64; ++n, shift += 7) {
+        value |= uint64_t(buf[n] & 0x7f) << shift;
+        if (!(buf[n] & 0x80))
+            return n + 1;
+    }
+    return 0;
+}
+
+inline uint64_t zigzag(uint64_t value, uint64_t previous)
+{
+    int64_t delta = int64_t(value - previous);
+    return (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+}
+
+inline uint64_t unzigzag(uint64_t encoded, uint64_t previous)
+{
+    int64_t delta = int64_t(encoded >> 1) ^ -int64_t(encoded & 1);
+    return previous + uint64_t(delta);
+}
+
+inline size_t write_header(uint8_t* buf, uint16_t version)
+{
+    trace_file_header header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = version;
+    memcpy(buf, &header, sizeof(header));
+    return sizeof(header);
+}
+
+/* file header followed by the summary (see trace_summary), returns their size */
+inline size_t write_header(uint8_t* buf, uint16_t version, const trace_summary& summary)
+{
+    write_header(buf, version | TRACE_SUMMARY_FLAG);
+    memcpy(buf + sizeof(trace_file_header), &summary, sizeof(summary));
+    return sizeof(trace_file_header) + sizeof(summary);
+}
+
+/* returns the format version of a trace starting with buf (v1 when there is no header) */
+inline uint16_t read_header(const uint8_t* buf, size_t len)
+{
+    trace_file_header header;
+    if (len < sizeof(header))
+        return TRACE_FORMAT_V1;
+    memcpy(&header, buf, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+        return TRACE_FORMAT_V1;
+    return header.version & ~TRACE_SUMMARY_FLAG;
+}
+
+/* bytes before the first record: 0 for v1, the file header and the summary if there is one */
+inline size_t header_size(const uint8_t* buf, size_t len)
+{
+    if (read_header(buf, len) == TRACE_FORMAT_V1)
+        return 0;
+    trace_file_header header;
+    memcpy(&header, buf, sizeof(header));
+    return sizeof(header) + ((header.version & TRACE_SUMMARY_FLAG) ? sizeof(trace_summary) : 0);
+}
+
+/* copy the summary of a trace starting with buf, false if there is none (or it was never filled in) */
+inline bool read_summary(const uint8_t* buf, size_t len, trace_summary& summary)
+{
+    if (header_size(buf, len) != sizeof(trace_file_header) + sizeof(trace_summary) || len < sizeof(trace_file_header) + sizeof(trace_summary))
+        return false;
+    memcpy(&summary, buf + sizeof(trace_file_header), sizeof(summary));
+    return summary.record_count != 0;
+}
+
+/* accumulates the summary of the records written to a trace */
+class SummaryCounter
+{
+public:
+    trace_summary summary;
+
+    SummaryCounter() { memset(&summary, 0, sizeof(summary)); }
+
+    void add(const trace_format& line)
+    {
+        if (summary.record_count++ == 0)
+            summary.processID = line.processID;
+        if (line.threadID >= summary.thread_count)
+            summary.thread_count = uint32_t(line.threadID + 1);
+        if (strcmp(line.opcode, "ROI_BEGIN") == 0)
+            ++summary.roi_count;
+        else if (strcmp(line.opcode, "ROI_END") != 0) {
+            ++summary.instruction_count;
+            if (line.threadID < uint64_t(TRACE_SUMMARY_MAX_THREADS))
+                ++summary.thread_instructions[line.threadID];
+        }
+    }
+};
+
+/* fill in the summary reserved at the start of a seekable trace file, the file position is kept */
+inline bool rewrite_header(FILE* file, uint16_t version, const trace_summary& summary)
+{
+    uint8_t buf[sizeof(trace_file_header) + sizeof(trace_summary)];
+    off_t end = ftello(file);
+    size_t length = write_header(buf, version, summary);
+    bool written = fflush(file) == 0 && fseeko(file, 0, SEEK_SET) == 0 && fwrite(buf, 1, length, file) == length;
+    fseeko(file, end, SEEK_SET);
+    return written;
+}
+
+/* per-thread delta state, identical on both sides of the stream */
+struct ThreadState
+{
+    uint64_t instPointer = 0;
+    uint64_t regionID = 0;
+    uint64_t sourceAddr[NUM_INSTR_SOURCES] = {0};
+    uint64_t destAddr[NUM_INSTR_DESTINATIONS] = {0};
+};
+
+class CodecState
+{
+public:
+    /* presize the per-thread state (e.g. from the trace summary) */
+    void reserve_threads(size_t count)
+    {
+        if (count > threads.size())
+            threads.resize(count);
+    }
+
+protected:
+    std::vector<ThreadState> threads;
+    uint64_t last_thread = 0;
+    uint64_t last_process = 0;
+
+    ThreadState& thread(uint64_t threadID)
+    {
+        if (threadID >= threads.size())
+            threads.resize(threadID + 1);
+        return threads[threadID];
+    }
+};
+
+class Encoder : public CodecState
+{
+public:
+    /* encode one record into buf (at least TRACE_V2_MAX_RECORD_SIZE bytes), returns its size */
+    size_t encode(const trace_format& line, uint8_t* buf)
+    {
+        ThreadState& state = thread(line.threadID);
+        size_t length = strnlen(line.opcode, MAX_OPCODE_LENGTH - 1);
+        std::string name(line.opcode, length);
+
+        uint8_t ctrl = 0, mask = 0;
+        if (line.threadID != last_thread) ctrl |= TRACE_V2_THREAD;
+        if (line.processID != last_process) ctrl |= TRACE_V2_PROCESS;
+        if (line.regionID != state.regionID) ctrl |= TRACE_V2_REGION;
+        if (line.instPointer == 0) ctrl |= TRACE_V2_NO_IP;
+
+        auto op = dictionary.find(name);
+        uint64_t op_index;
+        if (op == dictionary.end()) {
+            ctrl |= TRACE_V2_NEW_OPCODE;
+            op_index = dictionary.size();
+            dictionary.insert(std::make_pair(name, op_index));
+        }
+        else op_index = op->second;
+
+        for (int i = 0; i < NUM_INSTR_SOURCES; i++)
+            if (line.sourceAddr[i] != 0) mask |= 1 << i;
+        for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++)
+            if (line.destAddr[i] != 0) mask |= 1 << (NUM_INSTR_SOURCES + i);
+
+        size_t n = 0;
+        buf[n++] = ctrl;
+        buf[n++] = mask;
+        if (ctrl & TRACE_V2_THREAD) n += put_varint(buf + n, line.threadID);
+        if (ctrl & TRACE_V2_PROCESS) n += put_varint(buf + n, line.processID);
+        n += put_varint(buf + n, op_index);
+        if (ctrl & TRACE_V2_NEW_OPCODE) {
+            buf[n++] = uint8_t(length);
+            memcpy(buf + n, line.opcode, length);
+            n += length;
+        }
+        if (!(ctrl & TRACE_V2_NO_IP)) {
+            n += put_varint(buf + n, zigzag(line.instPointer, state.instPointer));
+            state.instPointer = line.instPointer;
+        }
+        if (ctrl & TRACE_V2_REGION) {
+            n += put_varint(buf + n, line.regionID);
+            state.regionID = line.regionID;
+        }
+        for (int i = 0; i < NUM_INSTR_SOURCES; i++)
+            if (mask & (1 << i)) {
+                n += put_varint(buf + n, zigzag(line.sourceAddr[i], state.sourceAddr[i]));
+                state.sourceAddr[i] = line.sourceAddr[i];
+            }
+        for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++)
+            if (mask & (1 << (NUM_INSTR_SOURCES + i))) {
+                n += put_varint(buf + n, zigzag(line.destAddr[i], state.destAddr[i]));
+                state.destAddr[i] = line.destAddr[i];
+            }
+
+        last_thread = line.threadID;
+        last_process = line.processID;
+        return n;
+    }
+
+private:
+    std::map<std::string, uint64_t> dictionary;
+};
+
+class Decoder : public CodecState
+{
+public:
+    /* decode one record from [buf, buf + len), returns the bytes consumed or 0 if the record is incomplete */
+    size_t decode(const uint8_t* buf, size_t len, trace_format& line)
+    {
+        const uint8_t* end = buf + len;
+        if (len < 2)
+            return 0;
+
+        uint8_t ctrl = buf[0], mask = buf[1];
+        size_t n = 2, used;
+        uint64_t value;
+
+        uint64_t threadID = last_thread, processID = last_process;
+        if (ctrl & TRACE_V2_THREAD) {
+            if (!(used = get_varint(buf + n, end, threadID))) return 0;
+            n += used;
+        }
+        if (ctrl & TRACE_V2_PROCESS) {
+            if (!(used = get_varint(buf + n, end, processID))) return 0;
+            n += used;
+        }
+
+        uint64_t op_index;
+        if (!(used = get_varint(buf + n, end, op_index))) return 0;
+        n += used;
+        if (ctrl & TRACE_V2_NEW_OPCODE) {
+            if (buf + n >= end) return 0;
+            size_t length = buf[n++];
+            if (length >= size_t(MAX_OPCODE_LENGTH) || buf + n + length > end) return 0;
+            if (op_index == dictionary.size())
+                dictionary.push_back(std::string(reinterpret_cast<const char*>(buf + n), length));
+            n += length;
+        }
+        if (op_index >= dictionary.size())
+            return 0;
+
+        // everything below updates the per-thread state, so first make sure the whole record is here.
+        ThreadState next = threads.size() > threadID ? threads[threadID] : ThreadState();
+        uint64_t instPointer = 0;
+        if (!(ctrl & TRACE_V2_NO_IP)) {
+            if (!(used = get_varint(buf + n, end, value))) return 0;
+            n += used;
+            instPointer = next.instPointer = unzigzag(value, next.instPointer);
+        }
+        if (ctrl & TRACE_V2_REGION) {
+            if (!(used = get_varint(buf + n, end, next.regionID))) return 0;
+            n += used;
+        }
+
+        memset(&line, 0, sizeof(line));
+        for (int i = 0; i < NUM_INSTR_SOURCES; i++)
+            if (mask & (1 << i)) {
+                if (!(used = get_varint(buf + n, end, value))) return 0;
+                n += used;
+                line.sourceAddr[i] = next.sourceAddr[i] = unzigzag(value, next.sourceAddr[i]);
+            }
+        for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++)
+            if (mask & (1 << (NUM_INSTR_SOURCES + i))) {
+                if (!(used = get_varint(buf + n, end, value))) return 0;
+                n += used;
+                line.destAddr[i] = next.destAddr[i] = unzigzag(value, next.destAddr[i]);
+            }
+
+        const std::string& name = dictionary[op_index];
+        memcpy(line.opcode, name.data(), name.size());
+        line.processID = processID;
+        line.threadID = threadID;
+        line.instPointer = instPointer;
+        line.regionID = next.regionID;
+
+        thread(threadID) = next;
+        last_thread = threadID;
+        last_process = processID;
+        last_opcode = op_index;
+        return n;
+    }
+
+    /* dictionary index of the opcode of the last decoded record (stable for the decoder's lifetime) */
+    uint64_t opcode_index() const { return last_opcode; }
+
+private:
+    std::vector<std::string> dictionary;
+    uint64_t last_opcode = 0;
+};
+
+} // namespace trace_codec
+
+#endif
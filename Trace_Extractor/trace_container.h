@@ -0,0 +1,252 @@
+#ifndef TRACE_CONTAINER_H
+#define TRACE_CONTAINER_H
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "trace_format.h"
+#include "trace_codec.h"
+
+/*
+ * v3 chunked container: the file header (and summary) is followed by independently zlib-compressed chunks of v2 records
+ * (the delta/dictionary state restarts in every chunk), then the footer index and a fixed-size trailer:
+ *   [header] [chunk 0] ... [chunk n-1] [chunk entries] [roi events] [trailer]
+ * Record numbers count every record of the trace (ROI markers included) from 0.
+ */
+
+struct trace_chunk_entry
+{
+    uint64_t offset;            // file offset of the compressed chunk.
+    uint64_t first_record;      // number of the first record in the chunk.
+    uint64_t first_roi_event;   // index of the chunk's first entry in the roi event table.
+    uint32_t compressed_size;
+    uint32_t raw_size;          // size of the v2 encoded records.
+    uint32_t record_count;
+    uint32_t roi_event_count;
+};
+
+struct trace_roi_event
+{
+    uint64_t record;            // record number of the ROI_BEGIN/ROI_END marker.
+    uint64_t regionID;
+    uint32_t threadID;
+    uint32_t is_begin;
+};
+
+const char TRACE_INDEX_MAGIC[8] = {'M', 'C', 'P', 'T', 'R', 'I', 'D', 'X'};
+
+struct trace_container_trailer
+{
+    uint64_t index_offset;
+    uint64_t chunk_count;
+    uint64_t record_count;
+    uint64_t roi_event_count;
+    char magic[8];
+};
+
+const uint32_t TRACE_CHUNK_RECORDS = 1 << 20;
+
+namespace trace_codec
+{
+
+/* footer index of a v3 container */
+struct ContainerIndex
+{
+    std::vector<trace_chunk_entry> chunks;
+    std::vector<trace_roi_event> roi_events;
+    uint64_t record_count = 0;
+
+    /* parse the index from the last bytes of the file (tail holds at least the trailer) */
+    bool parse(const uint8_t* tail, size_t tail_size, uint64_t tail_offset)
+    {
+        trace_container_trailer trailer;
+        if (tail_size < sizeof(trailer))
+            return false;
+        memcpy(&trailer, tail + tail_size - sizeof(trailer), sizeof(trailer));
+        if (memcmp(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic)) != 0 || trailer.index_offset < tail_offset)
+            return false;
+
+        size_t index_size = trailer.chunk_count * sizeof(trace_chunk_entry) + trailer.roi_event_count * sizeof(trace_roi_event);
+        const uint8_t* index = tail + (trailer.index_offset - tail_offset);
+        if (index + index_size + sizeof(trailer) != tail + tail_size)
+            return false;
+
+        chunks.resize(trailer.chunk_count);
+        roi_events.resize(trailer.roi_event_count);
+        if (!chunks.empty())
+            memcpy(&chunks[0], index, chunks.size() * sizeof(trace_chunk_entry));
+        if (!roi_events.empty())
+            memcpy(&roi_events[0], index + chunks.size() * sizeof(trace_chunk_entry), roi_events.size() * sizeof(trace_roi_event));
+        record_count = trailer.record_count;
+        return true;
+    }
+
+    /* read the index of a container held in memory (e.g. memory-mapped) */
+    bool load(const uint8_t* data, size_t size)
+    {
+        trace_container_trailer trailer;
+        if (size < sizeof(trailer))
+            return false;
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        if (trailer.index_offset > size)
+            return false;
+        return parse(data + trailer.index_offset, size - trailer.index_offset, trailer.index_offset);
+    }
+
+    /* read the index at the end of a seekable file */
+    bool load(FILE* file)
+    {
+        trace_container_trailer trailer;
+        if (fseeko(file, -off_t(sizeof(trailer)), SEEK_END) != 0 || fread(&trailer, sizeof(trailer), 1, file) != 1)
+            return false;
+        off_t end = ftello(file);
+        if (memcmp(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic)) != 0 || off_t(trailer.index_offset) > end)
+            return false;
+        std::vector<uint8_t> tail(end - trailer.index_offset);
+        if (fseeko(file, trailer.index_offset, SEEK_SET) != 0 || fread(tail.data(), 1, tail.size(), file) != tail.size())
+            return false;
+        return parse(tail.data(), tail.size(), trailer.index_offset);
+    }
+
+    /* chunk holding record number record (chunks.size() when past the end) */
+    size_t find_record(uint64_t record) const
+    {
+        size_t low = 0, high = chunks.size();
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (chunks[mid].first_record + chunks[mid].record_count <= record) low = mid + 1;
+            else high = mid;
+        }
+        return low;
+    }
+
+    /* record number of the k-th (from 1) ROI_BEGIN of regionID, false if the trace has fewer instances */
+    bool find_region(uint64_t regionID, uint64_t instance, uint64_t& record) const
+    {
+        for (const auto& event : roi_events)
+            if (event.is_begin && event.regionID == regionID && --instance == 0) {
+                record = event.record;
+                return true;
+            }
+        return false;
+    }
+};
+
+/* inflate one chunk into its v2 encoded records */
+inline bool inflate_chunk(const uint8_t* compressed, const trace_chunk_entry& entry, std::vector<uint8_t>& raw)
+{
+    raw.resize(entry.raw_size);
+    uLongf raw_size = entry.raw_size;
+    if (uncompress(raw.data(), &raw_size, compressed, entry.compressed_size) != Z_OK || raw_size != entry.raw_size)
+        return false;
+    return true;
+}
+
+/* writes a v3 container record by record */
+class ContainerWriter
+{
+public:
+    ContainerWriter(FILE* out, uint32_t chunk_records = TRACE_CHUNK_RECORDS, int level = Z_DEFAULT_COMPRESSION)
+        : out(out), chunk_records(chunk_records), level(level)
+    {
+        uint8_t header[sizeof(trace_file_header) + sizeof(trace_summary)];
+        offset = fwrite(header, 1, write_header(header, TRACE_FORMAT_V3, counter.summary), out);
+    }
+
+    void add(const trace_format& line)
+    {
+        counter.add(line);
+        if (raw.size() < raw_size + TRACE_V2_MAX_RECORD_SIZE)
+            raw.resize(2 * raw.size() + TRACE_V2_MAX_RECORD_SIZE);
+        raw_size += encoder.encode(line, raw.data() + raw_size);
+
+        bool begin = strcmp(line.opcode, "ROI_BEGIN") == 0;
+        if (begin || strcmp(line.opcode, "ROI_END") == 0) {
+            trace_roi_event event = {records, line.regionID, uint32_t(line.threadID), uint32_t(begin)};
+            roi_events.push_back(event);
+        }
+
+        ++records;
+        if (++chunk_record_count == chunk_records)
+            flush_chunk();
+    }
+
+    /* flush the last chunk and write the index, returns the total file size (0 when a chunk failed to compress) */
+    uint64_t finish()
+    {
+        flush_chunk();
+        if (failed)
+            return 0;
+        trace_container_trailer trailer;
+        trailer.index_offset = offset;
+        trailer.chunk_count = chunks.size();
+        trailer.record_count = records;
+        trailer.roi_event_count = roi_events.size();
+        memcpy(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic));
+        if (!chunks.empty())
+            offset += fwrite(&chunks[0], 1, chunks.size() * sizeof(trace_chunk_entry), out);
+        if (!roi_events.empty())
+            offset += fwrite(&roi_events[0], 1, roi_events.size() * sizeof(trace_roi_event), out);
+        offset += fwrite(&trailer, 1, sizeof(trailer), out);
+        rewrite_header(out, TRACE_FORMAT_V3, counter.summary);
+        return offset;
+    }
+
+    bool ok() const { return !failed; }
+
+private:
+    FILE* out;
+    uint32_t chunk_records;
+    int level;
+    uint64_t offset = 0;
+    uint64_t records = 0;
+    uint32_t chunk_record_count = 0;
+    size_t raw_size = 0;
+    std::vector<uint8_t> raw, compressed;
+    Encoder encoder;
+    SummaryCounter counter;
+    std::vector<trace_chunk_entry> chunks;
+    std::vector<trace_roi_event> roi_events;
+    uint64_t chunk_first_roi_event = 0;
+    bool failed = false;
+
+    void flush_chunk()
+    {
+        if (chunk_record_count == 0)
+            return;
+
+        uLongf compressed_size = compressBound(raw_size);
+        compressed.resize(compressed_size);
+        if (failed || compress2(compressed.data(), &compressed_size, raw.data(), raw_size, level) != Z_OK) {
+            // the index could not describe the chunk, the container is unusable.
+            failed = true;
+            encoder = Encoder();
+            chunk_first_roi_event = roi_events.size();
+            chunk_record_count = 0;
+            raw_size = 0;
+            return;
+        }
+
+        trace_chunk_entry entry;
+        entry.offset = offset;
+        entry.first_record = records - chunk_record_count;
+        entry.first_roi_event = chunk_first_roi_event;
+        entry.compressed_size = uint32_t(compressed_size);
+        entry.raw_size = uint32_t(raw_size);
+        entry.record_count = chunk_record_count;
+        entry.roi_event_count = uint32_t(roi_events.size() - chunk_first_roi_event);
+        chunks.push_back(entry);
+        offset += fwrite(compressed.data(), 1, compressed_size, out);
+
+        // every chunk decodes on its own.
+        encoder = Encoder();
+        chunk_first_roi_event = roi_events.size();
+        chunk_record_count = 0;
+        raw_size = 0;
+    }
+};
+
+} // namespace trace_codec
+
+#endif
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "trace_io.h"
+
+/*
+ * Converts MCPSim traces between the raw v1 records, the compact v2 encoding and the v3 chunked container.
+ *   trace_convert [-f 1|2|3] [-c <records per chunk>] <input trace> <output trace>
+ * The input version is detected from its header, the output version defaults to 2.
+ */
+
+int main(int argc, char* argv[])
+{
+    int out_version = TRACE_FORMAT_V2;
+    uint32_t chunk_records = TRACE_CHUNK_RECORDS;
+    int arg = 1;
+    while (argc - arg > 2 && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-f") == 0) out_version = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-c") == 0) chunk_records = strtoul(argv[arg + 1], NULL, 10);
+        else break;
+        arg += 2;
+    }
+    if (argc - arg != 2 || out_version < TRACE_FORMAT_V1 || out_version > TRACE_FORMAT_V3 || chunk_records == 0) {
+        std::cerr << "usage: " << argv[0] << " [-f 1|2|3] [-c <records per chunk>] <input trace> <output trace>" << std::endl;
+        return 1;
+    }
+
+    FILE* in = fopen(argv[arg], "rb");
+    FILE* out = fopen(argv[arg + 1], "wb");
+    if (in == NULL || out == NULL) {
+        std::cerr << "Can not open " << (in == NULL ? argv[arg] : argv[arg + 1]) << std::endl;
+        return 1;
+    }
+
+    trace_codec::Reader reader(in);
+    if (reader.version < TRACE_FORMAT_V1 || reader.version > TRACE_FORMAT_V3) {
+        std::cerr << "Unsupported or damaged trace (format version " << reader.version << ")" << std::endl;
+        return 1;
+    }
+
+    trace_codec::Writer writer(out, out_version, chunk_records);
+    unsigned long long records = 0;
+    trace_format line;
+    while (reader.next(line)) {
+        ++records;
+        writer.write(line);
+    }
+
+    if (reader.truncated())
+        std::cerr << "Warning: the trailing bytes of a truncated record are dropped." << std::endl;
+
+    unsigned long long out_bytes = writer.finish();
+    fclose(in);
+    fclose(out);
+    if (!writer.ok()) {
+        std::cerr << "Error: a chunk of the output failed to compress." << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Converted " << records << " records from v" << reader.version << " to v" << out_version
+              << " (" << reader.bytes << " -> " << out_bytes << " bytes)." << std::endl;
+    return 0;
+}
@@ -9,6 +9,7 @@ const int NUM_INSTR_DESTINATIONS = 4;
 const int NUM_INSTR_SOURCES = 4;
 const int MAX_OPCODE_LENGTH = 32;
 
+/* v1 trace record, also the decoded form every reader hands to the simulator */
 struct trace_format
 {
     uint64_t processID;
@@ -17,7 +18,52 @@ struct trace_format
     uint64_t sourceAddr[NUM_INSTR_SOURCES];
     uint64_t destAddr[NUM_INSTR_DESTINATIONS];
     uint64_t regionID;
-    char opcode[MAX_OPCODE_LENGTH];    
+    char opcode[MAX_OPCODE_LENGTH];
 };
 
-#endif
\ No newline at end of file
+/* v1 files are headerless, every later version starts with this 8 byte file header */
+const char TRACE_MAGIC[6] = {'M', 'C', 'P', 'T', 'R', 'C'};
+const uint16_t TRACE_FORMAT_V1 = 1;
+const uint16_t TRACE_FORMAT_V2 = 2;
+const uint16_t TRACE_FORMAT_V3 = 3;     // chunked, compressed v2 with a seekable index (see trace_container.h).
+
+struct trace_file_header
+{
+    char magic[6];
+    uint16_t version;
+};
+
+/*
+ * Optional trace summary, following the file header when the version carries TRACE_SUMMARY_FLAG. Writers
+ * reserve it when the trace is opened and fill it in when the trace is closed, so a trace that was never
+ * closed properly has a zero record_count, meaning "unknown".
+ */
+const uint16_t TRACE_SUMMARY_FLAG = 0x8000;
+const int TRACE_SUMMARY_MAX_THREADS = 64;
+
+struct trace_summary
+{
+    uint64_t record_count;          // every record, ROI markers included.
+    uint64_t instruction_count;     // records other than ROI markers.
+    uint64_t roi_count;             // ROI_BEGIN markers.
+    uint64_t processID;             // process of the first record.
+    uint32_t thread_count;          // highest threadID + 1.
+    uint32_t reserved;
+    uint64_t thread_instructions[TRACE_SUMMARY_MAX_THREADS];   // per threadID, higher threads only count in the totals.
+};
+
+/*
+ * v2 record layout (see trace_codec.h):
+ *   [ctrl:1] [slot mask:1] [threadID] [processID] [opcode index (+ name)] [instPointer] [regionID] [addresses]
+ * every field after the two header bytes is a LEB128 varint, optional fields are flagged in ctrl,
+ * slot mask bit i (0-3) marks sourceAddr[i], bit 4+i marks destAddr[i]. Addresses and instPointer are
+ * zigzag deltas against the previous value of the same slot of the same thread.
+ */
+const uint8_t TRACE_V2_THREAD = 1 << 0;     // threadID differs from the previous record.
+const uint8_t TRACE_V2_PROCESS = 1 << 1;    // processID differs from the previous record.
+const uint8_t TRACE_V2_REGION = 1 << 2;     // regionID differs from the previous record of this thread.
+const uint8_t TRACE_V2_NEW_OPCODE = 1 << 3; // opcode name follows its index (first use of the opcode).
+const uint8_t TRACE_V2_NO_IP = 1 << 4;      // instPointer is zero (ROI markers).
+const int TRACE_V2_MAX_RECORD_SIZE = 2 + 13 * 10 + 1 + MAX_OPCODE_LENGTH;
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef TRACE_IO_H
+#define TRACE_IO_H
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "trace_format.h"
+#include "trace_codec.h"
+#include "trace_container.h"
+
+/* sequential trace file reader/writer of every format version, shared by the offline tools */
+
+namespace trace_codec
+{
+
+/* sequential reader of any trace version */
+class Reader
+{
+public:
+    uint16_t version;
+    unsigned long long bytes = 0;
+    trace_summary summary;
+    bool has_summary = false;
+
+    Reader(FILE* in) : in(in), buffer(1 << 22)
+    {
+        size_t readable = fill(sizeof(trace_file_header) + sizeof(trace_summary));
+        version = read_header(buffer.data(), readable);
+        has_summary = read_summary(buffer.data(), readable, summary);
+        pos += header_size(buffer.data(), readable);
+        if (version == TRACE_FORMAT_V3 && !index.load(in))
+            version = 0;
+    }
+
+    bool next(trace_format& line)
+    {
+        if (version == TRACE_FORMAT_V1) {
+            if (fill(sizeof(trace_format)) < sizeof(trace_format))
+                return false;
+            memcpy(&line, buffer.data() + pos, sizeof(trace_format));
+            pos += sizeof(trace_format);
+            bytes += sizeof(trace_format);
+            return true;
+        }
+
+        if (version == TRACE_FORMAT_V3) {
+            // the chunk is decoded like a v2 stream held in memory.
+            while (chunk_pos == chunk.size()) {
+                if (next_chunk == index.chunks.size())
+                    return false;
+                const trace_chunk_entry& entry = index.chunks[next_chunk++];
+                std::vector<uint8_t> compressed(entry.compressed_size);
+                if (fseeko(in, entry.offset, SEEK_SET) != 0 || fread(compressed.data(), 1, compressed.size(), in) != compressed.size()
+                    || !inflate_chunk(compressed.data(), entry, chunk))
+                    return false;
+                bytes += entry.compressed_size;
+                decoder = Decoder();
+                chunk_pos = 0;
+            }
+            size_t used = decoder.decode(chunk.data() + chunk_pos, chunk.size() - chunk_pos, line);
+            chunk_pos += used;
+            return used != 0;
+        }
+
+        size_t len = fill(TRACE_V2_MAX_RECORD_SIZE);
+        size_t used = decoder.decode(buffer.data() + pos, len, line);
+        pos += used;
+        bytes += used;
+        return used != 0;
+    }
+
+    bool truncated() const { return version != TRACE_FORMAT_V3 && end != pos; }
+
+private:
+    FILE* in;
+    std::vector<uint8_t> buffer;
+    size_t pos = 0, end = 0;
+    Decoder decoder;
+    ContainerIndex index;
+    std::vector<uint8_t> chunk;
+    size_t chunk_pos = 0, next_chunk = 0;
+
+    /* keep at least need bytes buffered (unless the input ends), returns the buffered bytes */
+    size_t fill(size_t need)
+    {
+        size_t left = end - pos;
+        if (left >= need)
+            return left;
+        memmove(buffer.data(), buffer.data() + pos, left);
+        pos = 0;
+        end = left + fread(buffer.data() + left, 1, buffer.size() - left, in);
+        return end;
+    }
+};
+
+/* buffered writer of any trace version */
+class Writer
+{
+public:
+    Writer(FILE* out, uint16_t version, uint32_t chunk_records = TRACE_CHUNK_RECORDS, size_t buffer_size = 1 << 22)
+        : out(out), version(version), buffer(buffer_size)
+    {
+        if (version == TRACE_FORMAT_V3)
+            container = new ContainerWriter(out, chunk_records);
+        else if (version == TRACE_FORMAT_V2)
+            length = write_header(buffer.data(), version, counter.summary);
+    }
+
+    ~Writer() { delete container; }
+
+    void write(const trace_format& line)
+    {
+        if (container != NULL) {
+            container->add(line);
+            return;
+        }
+        counter.add(line);
+        if (length + TRACE_V2_MAX_RECORD_SIZE + sizeof(trace_format) > buffer.size())
+            flush();
+        if (version == TRACE_FORMAT_V1) {
+            memcpy(buffer.data() + length, &line, sizeof(trace_format));
+            length += sizeof(trace_format);
+        }
+        else
+            length += encoder.encode(line, buffer.data() + length);
+    }
+
+    /* write out everything buffered (and the v3 index), returns the file size */
+    unsigned long long finish()
+    {
+        if (container != NULL)
+            return bytes = container->finish();
+        flush();
+        if (version == TRACE_FORMAT_V2)
+            rewrite_header(out, version, counter.summary);    // not possible on pipes, the summary stays unknown.
+        return bytes;
+    }
+
+    bool ok() const { return container == NULL || container->ok(); }
+
+private:
+    FILE* out;
+    uint16_t version;
+    std::vector<uint8_t> buffer;
+    size_t length = 0;
+    unsigned long long bytes = 0;
+    Encoder encoder;
+    SummaryCounter counter;
+    ContainerWriter* container = NULL;
+
+    void flush()
+    {
+        bytes += fwrite(buffer.data(), 1, length, out);
+        length = 0;
+    }
+
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+};
+
+} // namespace trace_codec
+
+#endif
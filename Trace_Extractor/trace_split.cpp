@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "trace_io.h"
+
+/*
+ * Splits a multi-threaded MCPSim trace into one trace per thread, for the simulator's per_thread trace input.
+ *   trace_split [-f 1|2|3] [-c <records per chunk>] <input trace> <output base>
+ * The records of thread t go to <output base>.t in their original order (ROI markers included, so every
+ * thread sees its region boundaries exactly where the merged trace had them). The output version defaults
+ * to the input version.
+ */
+
+int main(int argc, char* argv[])
+{
+    int out_version = 0;
+    uint32_t chunk_records = TRACE_CHUNK_RECORDS;
+    int arg = 1;
+    while (argc - arg > 2 && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-f") == 0) out_version = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-c") == 0) chunk_records = strtoul(argv[arg + 1], NULL, 10);
+        else break;
+        arg += 2;
+    }
+    if (argc - arg != 2 || out_version < 0 || out_version > TRACE_FORMAT_V3 || chunk_records == 0) {
+        std::cerr << "usage: " << argv[0] << " [-f 1|2|3] [-c <records per chunk>] <input trace> <output base>" << std::endl;
+        return 1;
+    }
+
+    FILE* in = fopen(argv[arg], "rb");
+    if (in == NULL) {
+        std::cerr << "Can not open " << argv[arg] << std::endl;
+        return 1;
+    }
+
+    trace_codec::Reader reader(in);
+    if (reader.version < TRACE_FORMAT_V1 || reader.version > TRACE_FORMAT_V3) {
+        std::cerr << "Unsupported or damaged trace (format version " << reader.version << ")" << std::endl;
+        return 1;
+    }
+    if (out_version == 0)
+        out_version = reader.version;
+
+    const std::string base = argv[arg + 1];
+    std::vector<FILE*> files;
+    std::vector<trace_codec::Writer*> writers;
+    std::vector<unsigned long long> records;
+    trace_format line;
+    while (reader.next(line)) {
+        if (line.threadID >= writers.size()) {
+            files.resize(line.threadID + 1, NULL);
+            writers.resize(line.threadID + 1, NULL);
+            records.resize(line.threadID + 1, 0);
+        }
+        if (writers[line.threadID] == NULL) {
+            std::string name = base + "." + std::to_string(line.threadID);
+            files[line.threadID] = fopen(name.c_str(), "wb");
+            if (files[line.threadID] == NULL) {
+                std::cerr << "Can not open " << name << std::endl;
+                return 1;
+            }
+            // the buffers are smaller than trace_convert's, there is one per thread.
+            writers[line.threadID] = new trace_codec::Writer(files[line.threadID], out_version, chunk_records, 1 << 20);
+        }
+        writers[line.threadID]->write(line);
+        ++records[line.threadID];
+    }
+
+    if (reader.truncated())
+        std::cerr << "Warning: the trailing bytes of a truncated record are dropped." << std::endl;
+
+    bool failed = false;
+    for (size_t t = 0; t < writers.size(); t++) {
+        if (writers[t] == NULL)
+            continue;
+        unsigned long long bytes = writers[t]->finish();
+        if (!writers[t]->ok()) {
+            std::cerr << "Error: a chunk of " << base << "." << t << " failed to compress." << std::endl;
+            failed = true;
+        }
+        delete writers[t];
+        fclose(files[t]);
+        std::cerr << "Thread " << t << ": " << records[t] << " records (" << bytes << " bytes) -> " << base << "." << t << std::endl;
+    }
+    fclose(in);
+    return failed ? 1 : 0;
+}
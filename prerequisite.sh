@@ -1,4 +1,4 @@
 # sudo apt-get update
-sudo apt-get install g++ cmake libxerces-c-dev libboost-all-dev nlohmann-json3-dev gdb llvm clang
+sudo apt-get install g++ cmake libxerces-c-dev libboost-all-dev nlohmann-json3-dev zlib1g-dev gdb llvm clang
 cd ./common/DRAMPower
 make -j
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include "AnalyticalMemory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+using namespace ramulator;
+
+static int log2_of(long value)
+{
+    int n = 0;
+    while ((value >>= 1))
+        n++;
+    return n;
+}
+
+string AnalyticalMemory::Calibration::str() const
+{
+    char text[256];
+    snprintf(text, sizeof(text), "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+             hit_cycles, miss_cycles, bank_cycles, column_cycles, burst_cycles, link_cycles, flit_cycles);
+    return text;
+}
+
+/* seven comma separated values in the order of str(), false when the text does not hold them */
+bool AnalyticalMemory::Calibration::parse(const string& values)
+{
+    double* fields[] = {&hit_cycles, &miss_cycles, &bank_cycles, &column_cycles, &burst_cycles, &link_cycles,
+                        &flit_cycles};
+    stringstream ss(values);
+    string value;
+    for (auto field : fields) {
+        if (!getline(ss, value, ','))
+            return false;
+        char* end;
+        *field = strtod(value.c_str(), &end);
+        if (end == value.c_str() || *field < 0)
+            return false;
+    }
+    return !getline(ss, value, ',');
+}
+
+/* the fields Memory<HMC, Controller>::send slices off an address, lowest first */
+AnalyticalMemory::Layout::Layout(const Config& configs, HMC* spec)
+{
+    int* sz = spec->org_entry.count;
+    tx_bits = log2_of(spec->prefetch_size * spec->channel_width / 8);
+    banks = sz[int(HMC::Level::Bank)];
+
+    int column_bits = log2_of(sz[int(HMC::Level::Column)]) - log2_of(spec->prefetch_size);
+    int column_low = spec->maxblock_entry.flit_num_bits - tx_bits;
+    auto field = [&](HMC::Level level) { return make_pair(level, log2_of(sz[int(level)])); };
+    auto low = make_pair(HMC::Level::Column, column_low);
+    auto high = make_pair(HMC::Level::Column, column_bits - column_low);
+
+    string type = configs.contains("addressing_type") ? configs["addressing_type"] : "RoCoBaVa";
+    if (type == "RoBaCoVa")
+        fields = {low, field(HMC::Level::Vault), high, field(HMC::Level::Bank), field(HMC::Level::BankGroup),
+                  field(HMC::Level::Row)};
+    else if (type == "RoCoBaBgVa")
+        fields = {low, field(HMC::Level::Vault), field(HMC::Level::BankGroup), field(HMC::Level::Bank), high,
+                  field(HMC::Level::Row)};
+    else
+        fields = {low, field(HMC::Level::Vault), field(HMC::Level::Bank), field(HMC::Level::BankGroup), high,
+                  field(HMC::Level::Row)};
+}
+
+void AnalyticalMemory::Layout::decode(long addr, int& vault, int& bank, long& row) const
+{
+    int bank_group = 0;
+    addr >>= tx_bits;
+    for (auto& field : fields) {
+        long value = addr & ((1l << field.second) - 1);
+        addr >>= field.second;
+        switch (field.first) {
+            case HMC::Level::Vault: vault = value; break;
+            case HMC::Level::BankGroup: bank_group = value; break;
+            case HMC::Level::Bank: bank = value; break;
+            case HMC::Level::Row: row = value; break;
+            default: break;
+        }
+    }
+    bank += bank_group * banks;
+}
+
+long AnalyticalMemory::Layout::compose(int vault, int bank, long row, long column) const
+{
+    long addr = 0;
+    int shift = 0;
+    for (auto& field : fields) {
+        long value = 0;
+        switch (field.first) {
+            case HMC::Level::Vault: value = vault; break;
+            case HMC::Level::BankGroup: value = bank / banks; break;
+            case HMC::Level::Bank: value = bank % banks; break;
+            case HMC::Level::Row: value = row; break;
+            default:
+                value = column;
+                column >>= field.second;
+                break;
+        }
+        addr |= (value & ((1l << field.second) - 1)) << shift;
+        shift += field.second;
+    }
+    return addr << tx_bits;
+}
+
+AnalyticalMemory::AnalyticalMemory(const Config& configs, HMC* spec, const Calibration& calibration)
+    : spec(spec), calibration(calibration), layout(configs, spec), pages(memory_footprint, physical_page_replacement)
+{
+    int* sz = spec->org_entry.count;
+    capacity_per_stack = spec->channel_width / 8;
+    for (int lev = 0; lev < int(HMC::Level::MAX); lev++)
+        capacity_per_stack *= sz[lev];
+    max_address = capacity_per_stack * configs.get_stacks();
+    vaults = sz[int(HMC::Level::Vault)];
+    banks_per_vault = sz[int(HMC::Level::BankGroup)] * sz[int(HMC::Level::Bank)];
+    links = spec->source_links;
+    assert(links > 0);
+
+    banks.resize(vaults * banks_per_vault);
+    buses.resize(vaults);
+    write_free.resize(vaults, 0);
+    host_links.resize(links);
+
+    pages.init(configs, max_address);
+
+    int cores = configs.get_core_num() + configs.get_nmp_core_num();
+    dram_capacity
+        .name("dram_capacity")
+        .desc("Number of bytes in simulated DRAM")
+        .precision(0)
+        ;
+    dram_capacity = max_address;
+    num_dram_cycles
+        .name("dram_cycles")
+        .desc("Number of DRAM cycles simulated")
+        .precision(0)
+        ;
+    num_read_requests
+        .init(cores)
+        .name("read_requests")
+        .desc("Number of incoming read requests to DRAM")
+        .precision(0)
+        ;
+    num_write_requests
+        .init(cores)
+        .name("write_requests")
+        .desc("Number of incoming write requests to DRAM")
+        .precision(0)
+        ;
+    ramulator_active_cycles
+        .name("ramulator_active_cycles")
+        .desc("The total number of cycles that the DRAM part is active (serving R/W)")
+        .precision(0)
+        ;
+    memory_footprint
+        .name("memory_footprint")
+        .desc("memory footprint in byte")
+        .precision(0)
+        ;
+    physical_page_replacement
+        .name("physical_page_replacement")
+        .desc("The number of times that physical page replacement happens.")
+        .precision(0)
+        ;
+    read_bandwidth
+        .name("read_bandwidth")
+        .desc("Real read bandwidth(Bps)")
+        .precision(0)
+        ;
+    write_bandwidth
+        .name("write_bandwidth")
+        .desc("Real write bandwidth(Bps)")
+        .precision(0)
+        ;
+    read_latency_sum
+        .name("read_latency_sum")
+        .desc("The memory latency cycles (in memory time domain) sum for all read requests")
+        .precision(0)
+        ;
+    read_latency_avg
+        .name("read_latency_avg")
+        .desc("The average memory latency cycles (in memory time domain) per request for all read requests")
+        .precision(6)
+        ;
+    read_latency_ns_avg
+        .name("read_latency_ns_avg")
+        .desc("The average memory latency (ns) per request for all read requests in this channel")
+        .precision(6)
+        ;
+    read_transaction_bytes
+        .name("read_transaction_bytes")
+        .desc("The total byte of read transaction")
+        .precision(0)
+        ;
+    write_transaction_bytes
+        .name("write_transaction_bytes")
+        .desc("The total byte of write transaction")
+        .precision(0)
+        ;
+    row_hits
+        .name("row_hits")
+        .desc("Number of row hits")
+        .precision(0)
+        ;
+    row_conflicts
+        .name("row_conflicts")
+        .desc("Number of row conflicts")
+        .precision(0)
+        ;
+}
+
+AnalyticalMemory::~AnalyticalMemory()
+{
+    delete spec;
+}
+
+double AnalyticalMemory::clk_ns()
+{
+    return spec->speed_entry.tCK;
+}
+
+void AnalyticalMemory::tick()
+{
+    clk++;
+    num_dram_cycles++;
+    if (!responses.empty())
+        ramulator_active_cycles++;
+    while (!responses.empty() && responses.top().clk <= clk) {
+        Request req = responses.top().req;
+        responses.pop();
+        req.depart_hmc = clk;
+        // as in the cycle-level model, the host hears of its reads only, the NMP PUs of reads and writes
+        if (req.type == Request::Type::READ && !req.from_nmp)
+            read_latency_sum += req.depart_hmc - req.arrive_hmc;
+        if (req.type == Request::Type::READ || req.from_nmp)
+            req.callback(req);
+    }
+}
+
+/* take amount cycles of capacity from the cycle ready is in on, returns when it is all taken */
+double AnalyticalMemory::Timeline::reserve(long now, double ready, double amount)
+{
+    for (long past = max(cleared, now - HORIZON); past < now; past++)
+        used[past & (HORIZON - 1)] = 0;
+    cleared = max(cleared, now);
+
+    long cycle = max(now, long(ready));
+    while (cycle - now < HORIZON) {
+        float& share = used[cycle & (HORIZON - 1)];
+        double take = min(1.0 - share, amount);
+        share += take;
+        amount -= take;
+        if (amount <= 1e-9)
+            return cycle + share;
+        cycle++;
+    }
+    return cycle + amount;  // beyond the horizon, the rest of the way is assumed free
+}
+
+void AnalyticalMemory::Timeline::reset(long now)
+{
+    fill(used.begin(), used.end(), 0);
+    cleared = now;
+}
+
+/* the response time of the request is fixed here: bank, vault data bus, then the host link back. A bank serves
+   in send order, the bus and the link serve whatever is ready first. The cycle-level controller serves the reads
+   first and drains the writes when no read is left, so a write takes its bank but not the bus of the reads. */
+bool AnalyticalMemory::send(Request req)
+{
+    req.initial_addr = req.addr;
+    req.addr &= max_address - 1;
+    req.arrive_hmc = clk;
+
+    int vault = 0, bank = 0;
+    long row = 0;
+    layout.decode(req.addr, vault, bank, row);
+    bool read = (req.type == Request::Type::READ);
+    int payload_flits = spec->payload_flits;
+
+    Bank& target = banks[vault * banks_per_vault + bank];
+    double start = max(double(clk), target.free);
+    double time;
+    if (target.row == row) {
+        ++row_hits;
+        target.free = start + calibration.column_cycles;
+        time = start + calibration.hit_cycles;
+    } else {
+        ++row_conflicts;
+        target.row = row;
+        target.free = start + calibration.bank_cycles;
+        time = start + calibration.miss_cycles;
+    }
+    if (read)
+        time = max(time, buses[vault].reserve(clk, time - calibration.burst_cycles, calibration.burst_cycles));
+    else {
+        time = max(time, write_free[vault] + calibration.burst_cycles);
+        write_free[vault] = time;
+    }
+
+    if (!req.from_nmp) {
+        int link = (req.addr >> spec->maxblock_entry.flit_num_bits) % links;
+        double flits = (read ? 1 + payload_flits : 1) * calibration.flit_cycles;
+        time = host_links[link].reserve(clk, time, flits) + calibration.link_cycles;
+    }
+
+    if (read) {
+        ++num_read_requests[req.coreid];
+        read_transaction_bytes += payload_flits * 16;
+    } else {
+        ++num_write_requests[req.coreid];
+        write_transaction_bytes += payload_flits * 16;
+    }
+    responses.push({max(clk + 1, long(ceil(time))), sent++, req});
+    return true;
+}
+
+int AnalyticalMemory::pending_requests()
+{
+    return responses.size();
+}
+
+void AnalyticalMemory::finish(void)
+{
+    long dram_cycles = num_dram_cycles.value();
+    read_bandwidth = read_transaction_bytes.value() * 1e9 / (dram_cycles * clk_ns());
+    write_bandwidth = write_transaction_bytes.value() * 1e9 / (dram_cycles * clk_ns());
+    read_latency_avg = read_latency_sum.value() / num_read_requests.total();
+    read_latency_ns_avg = read_latency_avg.value() * clk_ns();
+}
+
+int AnalyticalMemory::get_vault_target(long addr)
+{
+    int vault = 0, bank = 0;
+    long row = 0;
+    layout.decode(addr & (max_address - 1), vault, bank, row);
+    return vault;
+}
+
+long AnalyticalMemory::get_memory_transection_info()
+{
+    return ((read_transaction_bytes.value() * 1e9) + (write_transaction_bytes.value() * 1e9));
+}
+
+double AnalyticalMemory::get_transaction_bytes()
+{
+    return read_transaction_bytes.value() + write_transaction_bytes.value();
+}
+
+/* drained like Memory<HMC, Controller>: the clock, the page mapping, and when each bank, bus and link is free */
+void AnalyticalMemory::checkpoint(Checkpoint& cp)
+{
+    assert(responses.empty());
+    cp.expect(banks.size(), "analytical memory banks");
+    cp.expect(links, "host links");
+    cp.io(clk);
+    cp.io(sent);
+    cp.io(banks);
+    cp.io(write_free);
+    for (auto& bus : buses)
+        bus.reset(clk);    // drained, nothing is reserved ahead
+    for (auto& link : host_links)
+        link.reset(clk);
+    pages.checkpoint(cp);
+}
+
+/* send the reads to the reference memory, at most window of them outstanding, and tick it until all have come
+   back. Returns the cycles taken, latency gets the average read latency without the first read. A refused read
+   is sent again the next cycle. */
+static long run_pattern(MemoryBase& reference, const vector<long>& addrs, bool from_nmp, size_t window,
+                        double& latency)
+{
+    long clk = 0;
+    size_t next = 0, outstanding = 0, done = 0;
+    double latency_sum = 0;
+    while (done < addrs.size()) {
+        while (next < addrs.size() && outstanding < window) {
+            long sent_at = clk;
+            bool first = (next == 0);
+            Request req(addrs[next], Request::Type::READ, [&, sent_at, first](Request& req) {
+                if (!first)
+                    latency_sum += clk - sent_at;
+                outstanding--;
+                done++;
+            }, 0, from_nmp);
+            if (!reference.send(req))
+                break;
+            next++;
+            outstanding++;
+        }
+        reference.tick();
+        clk++;
+        if (clk > 100000000l) {
+            printf("The analytical memory calibration did not finish.\n");
+            exit(1);
+        }
+    }
+    reference.restore_hmc_tags();
+    latency = latency_sum / max(size_t(1), addrs.size() - 1);
+    return clk;
+}
+
+/* every pattern reads from vault 0 (the host from the vaults behind link 0): row hits and row conflicts one at a
+   time for the latencies, then many at once for the occupancy of a bank (row conflicts, then row hits), a vault bus
+   and a link */
+AnalyticalMemory::Calibration AnalyticalMemory::calibrate(const Config& configs, HMC* spec, MemoryBase& reference)
+{
+    const int samples = 64, loaded = 512;
+    Layout layout(configs, spec);
+    int* sz = spec->org_entry.count;
+    int vaults = sz[int(HMC::Level::Vault)];
+    int banks = sz[int(HMC::Level::BankGroup)] * sz[int(HMC::Level::Bank)];
+    int columns = sz[int(HMC::Level::Column)] / spec->prefetch_size;
+    int links = spec->source_links;
+    int link_shift = spec->maxblock_entry.flit_num_bits;
+    Calibration calibration;
+    double latency;
+
+    vector<long> hits, conflicts, queued, streamed, spread, host, host_hits;
+    for (int i = 0; i < samples; i++) {
+        hits.push_back(layout.compose(0, 0, 1, i % columns));
+        conflicts.push_back(layout.compose(0, 0, i + 2, 0));
+        queued.push_back(layout.compose(0, 0, i + 2 + samples, 0));
+        host_hits.push_back(layout.compose(0, 1, 1, i % columns));
+    }
+    for (int i = 0; i < loaded; i++) {
+        streamed.push_back(layout.compose(0, 0, 1, i % columns));
+        spread.push_back(layout.compose(0, i % banks, 2, i / banks % columns));
+    }
+    for (int i = 0; host.size() < size_t(loaded); i++) {
+        long addr = layout.compose(i % vaults, i / vaults % banks, 2, i / (vaults * banks) % columns);
+        if ((addr >> link_shift) % links == 0)
+            host.push_back(addr);
+    }
+
+    run_pattern(reference, hits, true, 1, latency);
+    calibration.hit_cycles = latency;
+    run_pattern(reference, conflicts, true, 1, latency);
+    calibration.miss_cycles = latency;
+    calibration.bank_cycles = double(run_pattern(reference, queued, true, queued.size(), latency)) / samples;
+    calibration.column_cycles = double(run_pattern(reference, streamed, true, streamed.size(), latency)) / loaded;
+    calibration.burst_cycles = double(run_pattern(reference, spread, true, spread.size(), latency)) / loaded;
+    calibration.flit_cycles = double(run_pattern(reference, host, false, host.size(), latency)) / loaded
+                              / (1 + spec->payload_flits);
+    run_pattern(reference, host_hits, false, 1, latency);
+    calibration.link_cycles = max(0.0, latency - calibration.hit_cycles - (1 + spec->payload_flits) * calibration.flit_cycles);
+
+    // kept to the precision str() prints, a run given the printed values is the same run
+    double* fields[] = {&calibration.hit_cycles, &calibration.miss_cycles, &calibration.bank_cycles,
+                        &calibration.column_cycles, &calibration.burst_cycles, &calibration.link_cycles,
+                        &calibration.flit_cycles};
+    for (auto field : fields)
+        *field = round(*field * 1000) / 1000;
+    return calibration;
+}
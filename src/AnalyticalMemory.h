@@ -0,0 +1,138 @@
+#ifndef __ANALYTICAL_MEMORY_H
+#define __ANALYTICAL_MEMORY_H
+
+#include "Checkpoint.h"
+#include "Config.h"
+#include "HMC.h"
+#include "Memory.h"
+#include "PageAllocator.h"
+#include "Request.h"
+#include "Statistics.h"
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+/*
+ * fast stand-in for Memory<HMC, Controller> (memory_model = Analytical): no DRAM commands are scheduled. Every vault
+ * is a set of banks in front of one data bus and every host link a pipe of response flits. A bank serves in send
+ * order, the bus and the links serve whatever is ready first, and the writes take the bus after the reads. A request
+ * gets its response time when it is sent; tick() only hands out the responses that are due. The latencies and
+ * occupancies come from a calibration run on the cycle-level model.
+ */
+class AnalyticalMemory : public MemoryBase
+{
+public:
+    // in memory cycles, fitted on the cycle-level model by calibrate() (analytical_calibration keeps them)
+    struct Calibration {
+        double hit_cycles = 0;      // unloaded read latency in the vault when the row is open
+        double miss_cycles = 0;     // unloaded read latency in the vault when another row is open
+        double bank_cycles = 0;     // a bank is busy this long for each row it opens
+        double column_cycles = 0;   // and this long for each access to the open row
+        double burst_cycles = 0;    // the vault data bus is busy this long for each request
+        double link_cycles = 0;     // the host links add this much to the round trip
+        double flit_cycles = 0;     // a host link is busy this long for each response flit
+
+        std::string str() const;
+        bool parse(const std::string& values);
+    };
+
+    AnalyticalMemory(const Config& configs, HMC* spec, const Calibration& calibration);
+    ~AnalyticalMemory();
+
+    // drive the reference memory with the calibration patterns and fit the parameters of the model to it
+    static Calibration calibrate(const Config& configs, HMC* spec, MemoryBase& reference);
+
+    double clk_ns();
+    void tick();
+    bool send(Request req);
+    int pending_requests();
+    void finish(void);
+    long page_allocator(long addr, int coreid) { return pages.translate(addr, coreid); }
+    void record_core(int coreid) {}
+    long get_memory_transection_info();
+    double get_transaction_bytes();
+    int pending_link_packets() { return 0; }  // the link time is part of the response time
+    void restore_hmc_tags() {}                 // no tags are held, every response returns its tag
+    int get_vault_target(long addr);
+    void checkpoint(Checkpoint& cp);
+
+private:
+    // where the vault, bank and row of an address are, for the addressing_type of Memory<HMC, Controller>
+    struct Layout {
+        std::vector<std::pair<HMC::Level, int>> fields;     // fields above the transaction bits, lowest first
+        int tx_bits;
+        int banks;                                          // per bank group
+
+        Layout(const Config& configs, HMC* spec);
+        void decode(long addr, int& vault, int& bank, long& row) const;
+        long compose(int vault, int bank, long row, long column) const;
+    };
+    // capacity of a bus or a link over the next cycles: a request takes the first free capacity from the cycle it
+    // is ready on, so it does not wait for the ones sent before it that are ready later
+    class Timeline {
+    public:
+        Timeline() : used(HORIZON, 0) {}
+        double reserve(long now, double ready, double amount);
+        void reset(long now);
+    private:
+        static const long HORIZON = 4096;   // cycles ahead, power of 2
+        std::vector<float> used;            // share of each cycle taken, by cycle modulo HORIZON
+        long cleared = 0;                   // the cycles before it are past and free again
+    };
+    struct Bank {
+        long row = -1;      // open row, -1 when closed
+        double free = 0;    // the bank can open another row from then on
+    };
+    struct Response {
+        long clk;
+        long seq;       // send order among the responses due at the same cycle
+        Request req;
+        bool operator<(const Response& other) const {
+            return clk > other.clk || (clk == other.clk && seq > other.seq);
+        }
+    };
+
+    HMC* spec;
+    Calibration calibration;
+    long max_address;
+    long capacity_per_stack;
+    int vaults;
+    int links;
+    int banks_per_vault;
+    Layout layout;
+
+    long clk = 0;
+    long sent = 0;
+    std::vector<Bank> banks;
+    std::vector<Timeline> buses;        // per vault, for the reads
+    std::vector<double> write_free;     // per vault, for the writes
+    std::vector<Timeline> host_links;   // per host link, memory to host
+    std::priority_queue<Response> responses;
+
+    ScalarStat dram_capacity;
+    ScalarStat num_dram_cycles;
+    VectorStat num_read_requests;
+    VectorStat num_write_requests;
+    ScalarStat ramulator_active_cycles;
+    ScalarStat memory_footprint;
+    ScalarStat physical_page_replacement;
+    ScalarStat read_bandwidth;
+    ScalarStat write_bandwidth;
+    ScalarStat read_latency_avg;
+    ScalarStat read_latency_ns_avg;
+    ScalarStat read_latency_sum;
+    ScalarStat read_transaction_bytes;
+    ScalarStat write_transaction_bytes;
+    ScalarStat row_hits;
+    ScalarStat row_conflicts;
+
+    PageAllocator pages;    // the translation of Memory<HMC, Controller>, drawing the same pages
+};
+
+} /* namespace ramulator */
+
+#endif /* __ANALYTICAL_MEMORY_H */
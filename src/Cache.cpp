@@ -14,6 +14,8 @@
 
 namespace ramulator
 {
+  const long Cache::EMPTY_TAG;
+
   /* defination of cache constructor */
   Cache::Cache(int size, int assoc, int block_size, int mshr_entry_num, Level level,
                std::shared_ptr<CacheSystem> cachesys, bool is_nmp) : level(level), cachesys(cachesys), higher_cache(0),
@@ -51,6 +53,20 @@ namespace ramulator
     debug_cache("index_mask 0x%x", index_mask);
     debug_cache("tag_offset %d", tag_offset);
 
+    // every set starts empty, the arrays are never resized afterwards.
+    long slots = long(block_num) * assoc;
+    line_tag.assign(slots, EMPTY_TAG);
+    line_addr.assign(slots, 0);
+    line_core.assign(slots, 0);
+    line_lock.assign(slots, false);
+    line_dirty.assign(slots, false);
+    line_prefetched.assign(slots, false);
+    set_size.assign(block_num, 0);
+    replacement.reset(ReplacementPolicy::create(cachesys->replacement[int(level)], level_string, block_num, assoc));
+    prefetcher.reset(Prefetcher::create(cachesys->prefetcher[int(level)], level_string, block_size,
+                                        cachesys->prefetch_degree));
+    mshr_entries.reserve(mshr_entry_num);
+
     /* setup stats metrices for cache */
     cache_read_miss.name(level_string + string("_cache_read_miss"))
         .desc("cache read miss count")
@@ -98,6 +114,11 @@ namespace ramulator
 
   /* when core send any type of memory request this function will handle, and forwd to all the cache level */
   bool Cache::send(Request req)
+  {
+    return access(req, nullptr);
+  }
+
+  bool Cache::access(Request req, Cache *higher)
   {
     debug_cache("level %d req.addr %lx req.type %d, index %d, tag %ld",
                 int(level), req.addr, int(req.type), get_index(req.addr), get_tag(req.addr));
@@ -108,18 +129,27 @@ namespace ramulator
     else
       cache_read_access++;
 
-    // if there isn't a set, create it.
-    auto &lines = get_lines(req.addr);
-    std::list<Line>::iterator line;
+    int set = get_index(req.addr);
+    int way;
 
-    if (is_hit(lines, req.addr, &line))
+    if (is_hit(set, req.addr, &way))
     {
-      lines.push_back(Line(req.addr, get_tag(req.addr), false, line->dirty || (req.type == Request::Type::WRITE), req.coreid));
-      lines.erase(line);
-      cachesys->hit_list.push_back(make_pair(cachesys->clk + latency[int(level)], req));
+      long hit = slot(set, way);
+      bool prefetch_hit = line_prefetched[hit] && !req.prefetch;
+      if (prefetch_hit)
+      {
+        line_prefetched[hit] = false;
+        prefetcher->useful++;
+      }
+      line_addr[hit] = req.addr;
+      line_dirty[hit] = line_dirty[hit] || (req.type == Request::Type::WRITE);
+      line_core[hit] = req.coreid;
+      replacement->touched(set, way);
+      cachesys->hit_list.push(cachesys->clk + latency[int(level)], req);
       cache_hit++;
       debug_cache("hit, update timestamp %ld", cachesys->clk);
       debug_cache("hit finish time %ld", cachesys->clk + latency[int(level)]);
+      prefetch(req, false, prefetch_hit);
       return true;
     }
     else
@@ -140,17 +170,27 @@ namespace ramulator
 
       // look it up in MSHR entries
       assert(req.type == Request::Type::READ);
-      auto mshr = hit_mshr(req.addr);
+      auto mshr = mshr_entries.find(align(req.addr));
       if (mshr != mshr_entries.end())
       {
         debug_cache("hit mshr");
         cache_mshr_hit++;
-        mshr->second->dirty = dirty || mshr->second->dirty;
+        line_dirty[mshr->second.slot] = dirty || line_dirty[mshr->second.slot];
+        auto &waiters = mshr->second.waiters;
+        if (higher != nullptr && find(waiters.begin(), waiters.end(), higher) == waiters.end())
+          waiters.push_back(higher);
+        if (mshr->second.prefetch && !req.prefetch)
+        {
+          mshr->second.prefetch = false;
+          line_prefetched[mshr->second.slot] = false;
+          prefetcher->late++;
+        }
+        prefetch(req, true, false);
         return true;
       }
 
       // all requests come to this stage will be READ, so they should be recorded in MSHR entries.
-      if (mshr_entries.size() == mshr_entry_num)
+      if (mshr_entries.size() == mshr_entry_num || (req.prefetch && !prefetch_room()))
       {
         // when no MSHR entries available, the miss request is stalling.
         cache_mshr_unavailable++;
@@ -159,53 +199,104 @@ namespace ramulator
       }
 
       // check whether there is a line available.
-      if (all_sets_locked(lines))
+      if (all_sets_locked(set))
       {
         cache_set_unavailable++;
         return false;
       }
 
-      auto newline = allocate_line(lines, req.addr, req.coreid);
-      if (newline == lines.end())
+      int newline = allocate_line(set, req.addr, req.coreid);
+      if (newline < 0)
         return false;
 
       cache_load_blocks++;
 
-      newline->dirty = dirty;
+      line_dirty[slot(set, newline)] = dirty;
 
       // add to MSHR entries.
-      mshr_entries.push_back(make_pair(req.addr, newline));
+      MSHR &entry = mshr_entries[align(req.addr)];
+      entry.slot = slot(set, newline);
+      if (higher != nullptr)
+        entry.waiters.push_back(higher);
 
       // send the request to next level cache.
       if (!is_last_level)
       {
-        if (!lower_cache->send(req))
+        if (!lower_cache->access(req, this))
         {
           retry_list.push_back(req);
         }
       }
       else
       {
-        cachesys->wait_list.push_back(make_pair(cachesys->clk + latency[int(level)], req));
+        cachesys->wait(cachesys->clk + latency[int(level)], req);
       }
+      prefetch(req, true, false);
       return true;
     }
   }
 
+  /* the proposed lines that are held or being filled already are skipped. Nothing is prefetched while the lower
+     level refuses requests: it refuses the prefetches from above too once they would take its last MSHR entries. */
+  void Cache::prefetch(const Request &req, bool miss, bool prefetch_hit)
+  {
+    if (prefetcher == nullptr || req.prefetch || req.instruction_request)
+      return;
+    prefetcher->access(req.addr, req.pc, miss, prefetch_hit);
+    for (long addr : prefetcher->candidates)
+    {
+      int set = get_index(addr);
+      if (find_way(set, get_tag(addr)) >= 0)
+        continue;
+      if (!prefetch_room() || !retry_list.empty() || all_sets_locked(set))
+      {
+        prefetcher->throttled++;
+        continue;
+      }
+      int way = allocate_line(set, addr, req.coreid);
+      if (way < 0)
+      {
+        prefetcher->throttled++;
+        continue;
+      }
+      line_prefetched[slot(set, way)] = true;
+      MSHR &entry = mshr_entries[align(addr)];
+      entry.slot = slot(set, way);
+      entry.prefetch = true;
+      prefetcher->issued++;
+
+      // the core is called back like for its own miss, no instruction of its window waits for the line.
+      Request fetch = req;
+      fetch.addr = addr;
+      fetch.type = Request::Type::READ;
+      fetch.prefetch = true;
+      if (!is_last_level)
+      {
+        if (!lower_cache->access(fetch, this))
+        {
+          retry_list.push_back(fetch);
+        }
+      }
+      else
+      {
+        cachesys->wait(cachesys->clk + latency[int(level)], fetch);
+      }
+    }
+  }
+
   /* this function the cache line which contain addr (address) with dirty set flag */
   void Cache::evictline(long addr, bool dirty)
   {
-    auto it = cache_lines.find(get_index(addr));
-    assert(it != cache_lines.end()); // check inclusive cache.
-    auto &lines = it->second;
-    auto line = find_if(lines.begin(), lines.end(),
-                        [addr, this](Line l)
-                        { return (l.tag == get_tag(addr)); });
-    assert(line != lines.end());
-
-    // update LRU queue. The dirty bit will be set if the dirty bit inherited from higher level(s) is set.
-    lines.push_back(Line(addr, get_tag(addr), false, dirty || line->dirty, line->coreId));
-    lines.erase(line);
+    int set = get_index(addr);
+    int way = find_way(set, get_tag(addr));
+    assert(way >= 0); // check inclusive cache.
+
+    // update the replacement state. The dirty bit will be set if the dirty bit inherited from higher level(s) is set.
+    long line = slot(set, way);
+    line_addr[line] = addr;
+    line_lock[line] = false;
+    line_dirty[line] = dirty || line_dirty[line];
+    replacement->written_back(set, way);
   }
 
   /* this invalidate the cache line as state-of-the-art concept */
@@ -213,21 +304,21 @@ namespace ramulator
   {
     long delay = latency_each[int(level)];
     bool dirty = false;
-    auto &lines = get_lines(addr);
-    if (lines.size() == 0)
+    int set = get_index(addr);
+    if (set_size[set] == 0)
     {
       // the line of this address doesn't exist.
       return make_pair(0, false);
     }
-    auto line = find_if(lines.begin(), lines.end(),
-                        [addr, this](Line l)
-                        { return (l.tag == get_tag(addr)); });
+    int way = find_way(set, get_tag(addr));
+    bool line_dirty_bit = false;
     // iff the line is in this level cache, then erase it from the buffer.
-    if (line != lines.end())
+    if (way >= 0)
     {
-      assert(!line->lock);
+      assert(!line_lock[slot(set, way)]);
       debug_cache("invalidate %lx @ level %d", addr, int(level));
-      lines.erase(line);
+      line_dirty_bit = line_dirty[slot(set, way)];
+      remove_line(set, way);
     }
     else
     {
@@ -249,26 +340,27 @@ namespace ramulator
         {
           max_delay = max(max_delay, delay + result.first);
         }
-        dirty = dirty || line->dirty || result.second;
+        dirty = dirty || line_dirty_bit || result.second;
       }
       delay = max_delay;
     }
     else
     {
-      dirty = line->dirty;
+      dirty = line_dirty_bit;
     }
     return make_pair(delay, dirty);
   }
 
   /* this will evict (remove) the cache line which contain victim address */
-  void Cache::evict(std::list<Line> *lines, std::list<Line>::iterator victim)
+  void Cache::evict(int set, int victim)
   {
-    debug_cache("level %d miss evict victim %lx", int(level), victim->addr);
+    long line = slot(set, victim);
+    debug_cache("level %d miss evict victim %lx", int(level), line_addr[line]);
     cache_eviction++;
-    long addr = victim->addr;
+    long addr = line_addr[line];
     long invalidate_time = 0;
-    bool dirty = victim->dirty;
-    long coreId = victim->coreId;
+    bool dirty = line_dirty[line];
+    long coreId = line_core[line];
 
     // first invalidate the victim line in higher level.
     if (higher_cache.size())
@@ -277,7 +369,7 @@ namespace ramulator
       {
         auto result = hc->invalidate(addr);
         invalidate_time = max(invalidate_time, result.first + (result.second ? latency_each[int(level)] : 0));
-        dirty = dirty || result.second || victim->dirty;
+        dirty = dirty || result.second || line_dirty[line];
       }
     }
 
@@ -297,7 +389,7 @@ namespace ramulator
       {
         Request write_req(addr, Request::Type::WRITE, coreId, is_nmp);
         cache_write_back_hmc++;
-        cachesys->wait_list.push_back(make_pair(cachesys->clk + invalidate_time + latency[int(level)], write_req));
+        cachesys->wait(cachesys->clk + invalidate_time + latency[int(level)], write_req);
         debug_cache("inject one write request to memory system "
                     "addr %lx, invalidate time %ld, issue time %ld",
                     write_req.addr, invalidate_time,
@@ -305,7 +397,7 @@ namespace ramulator
       }
     }
 
-    lines->erase(victim);
+    remove_line(set, victim);
   }
 
   // This function is not working....
@@ -328,11 +420,12 @@ namespace ramulator
   /* flush the dirty cache lines to mmeory and evict those lines */
   void Cache::flush_all_dirty_lines() 
   {
-      for (auto &set_pair : cache_lines) {
-          for (auto &line : set_pair.second) {
-              if (line.dirty) {
-                  flush_line(line.addr);
-                  line.dirty = false;
+      for (unsigned int set = 0; set < block_num; set++) {
+          for (int way : replacement->victims(set)) {
+              long line = slot(set, way);
+              if (line_dirty[line]) {
+                  flush_line(line_addr[line]);
+                  line_dirty[line] = false;
               }
           }
       }
@@ -345,62 +438,141 @@ namespace ramulator
       } else {
           Request write_req(addr, Request::Type::WRITE, 0);
           if (!cachesys->send_memory(write_req)) {
-              cachesys->wait_list.push_back({cachesys->clk, write_req});
+              cachesys->wait(cachesys->clk, write_req);
           }
       }
   }
 
+  /* functional access: the policy learns from it, but its stats are left as they are */
+  bool Cache::warm(long addr, bool write, long coreId)
+  {
+    replacement->counting = false;
+    bool filled = warm_line(addr, write, coreId);
+    replacement->counting = true;
+    return filled;
+  }
+
+  /* a miss fills the lower levels first, the victim is invalidated above and its dirty bit moves down (the write-back
+     of an LLC victim is dropped, the memory holds no data) */
+  bool Cache::warm_line(long addr, bool write, long coreId)
+  {
+    int set = get_index(addr);
+    int way;
+    if (!is_hit(set, addr, &way) && way >= 0)
+      return false;    // being filled by a request in flight (the MSHR holds the line), left as it is.
+    if (way >= 0)
+    {
+      long line = slot(set, way);
+      line_addr[line] = addr;
+      line_dirty[line] = line_dirty[line] || write;
+      line_core[line] = coreId;
+      replacement->touched(set, way);
+      return true;
+    }
+
+    if (!is_last_level && !lower_cache->warm(addr, false, coreId))
+      return false;    // not filled below, the inclusion would break.
+
+    if (set_size[set] >= assoc)
+    {
+      // between detailed parts (sampling) lines can still be locked by requests in flight, they are not evicted.
+      int victim = select_victim(set);
+      if (victim < 0)
+        return false;
+      long line = slot(set, victim);
+      bool dirty = line_dirty[line];
+      for (auto hc : higher_cache)
+        dirty = hc->invalidate(line_addr[line]).second || dirty;
+      if (!is_last_level)
+        lower_cache->evictline(line_addr[line], dirty);
+      remove_line(set, victim);
+    }
+    insert_line(set, addr, false, write, coreId);
+    return true;
+  }
+
   /* it allocate new cache line to store data */
-  std::list<Cache::Line>::iterator Cache::allocate_line(std::list<Line> &lines, long addr, long coreId)
+  int Cache::allocate_line(int set, long addr, long coreId)
   {
     // check if an eviction is needed.
-    if (need_eviction(lines, addr))
+    if (need_eviction(set, addr))
     {
       // get victim, the first one might still be locked due to reorder in MC.
-      auto victim = find_if(lines.begin(), lines.end(),
-                            [this](Line line)
-                            {
-                              bool check = !line.lock;
-                              if (!is_first_level)
-                              {
-                                for (auto hc : higher_cache)
-                                {
-                                  if (!check)
-                                  {
-                                    return check;
-                                  }
-                                  check = check && hc->check_unlock(line.addr);
-                                }
-                              }
-                              return check;
-                            });
-      if (victim == lines.end())
+      int victim = select_victim(set);
+      if (victim < 0)
       {
         return victim; // doesn't exist a line that's already unlocked in each level.
       }
-      assert(victim != lines.end());
-      evict(&lines, victim);
+      evict(set, victim);
     }
 
     // allocate newline, with lock bit on and dirty bit off.
-    lines.push_back(Line(addr, get_tag(addr), coreId));
-    auto last_element = lines.end();
-    --last_element;
-    return last_element;
+    return insert_line(set, addr, true, false, coreId);
   }
 
   /* check addr containing line exist in cache or not */
-  bool Cache::is_hit(std::list<Line> &lines, long addr, std::list<Line>::iterator *pos_ptr)
+  bool Cache::is_hit(int set, long addr, int *way_ptr)
   {
-    auto pos = find_if(lines.begin(), lines.end(),
-                       [addr, this](Line l)
-                       { return (l.tag == get_tag(addr)); });
-    *pos_ptr = pos;
-    if (pos == lines.end())
+    int way = find_way(set, get_tag(addr));
+    *way_ptr = way;
+    if (way < 0)
     {
       return false;
     }
-    return !pos->lock;
+    return !line_lock[slot(set, way)];
+  }
+
+  /* the new line takes the first free way */
+  int Cache::insert_line(int set, long addr, bool lock, bool dirty, long coreId)
+  {
+    int way = find_way(set, EMPTY_TAG);
+    assert(way >= 0);
+    fill_way(set, way, addr, lock, dirty, coreId);
+    return way;
+  }
+
+  void Cache::fill_way(int set, int way, long addr, bool lock, bool dirty, long coreId)
+  {
+    long line = slot(set, way);
+    assert(line_tag[line] == EMPTY_TAG);
+    line_tag[line] = get_tag(addr);
+    line_addr[line] = addr;
+    line_core[line] = coreId;
+    line_lock[line] = lock;
+    line_dirty[line] = dirty;
+    line_prefetched[line] = false;
+    set_size[set]++;
+    replacement->filled(set, way, addr);
+  }
+
+  void Cache::remove_line(int set, int way)
+  {
+    replacement->removed(set, way);
+    line_tag[slot(set, way)] = EMPTY_TAG;
+    set_size[set]--;
+  }
+
+  /* the lines the higher levels still fill (locked) can not be evicted */
+  int Cache::select_victim(int set)
+  {
+    for (int candidate : replacement->victims(set))
+    {
+      bool check = !line_lock[slot(set, candidate)];
+      for (auto hc : higher_cache)
+      {
+        if (!check)
+        {
+          break;
+        }
+        check = check && hc->check_unlock(line_addr[slot(set, candidate)]);
+      }
+      if (check)
+      {
+        replacement->evicted(set, candidate);
+        return candidate;
+      }
+    }
+    return -1;
   }
 
   /* used to concate one cache level to another level */
@@ -412,18 +584,16 @@ namespace ramulator
   };
 
   /* check the cache need eviction before allocate new ccahe line or not */
-  bool Cache::need_eviction(const std::list<Line> &lines, long addr)
+  bool Cache::need_eviction(int set, long addr)
   {
-    if (find_if(lines.begin(), lines.end(),
-                [addr, this](Line l)
-                { return (get_tag(addr) == l.tag); }) != lines.end())
+    if (find_way(set, get_tag(addr)) >= 0)
     {
       // due to MSHR, the program can't reach here. Just for checking
       assert(false);
     }
     else
     {
-      if (lines.size() < assoc)
+      if (set_size[set] < assoc)
       {
         return false;
       }
@@ -439,16 +609,17 @@ namespace ramulator
   {
     debug_cache("level %d", int(level));
 
-    auto it = find_if(mshr_entries.begin(), mshr_entries.end(),
-                      [&req, this](std::pair<long, std::list<Line>::iterator> mshr_entry)
-                      {
-                        return (align(mshr_entry.first) == align(req.addr));
-                      });
-
+    auto it = mshr_entries.find(align(req.addr));
     if (it != mshr_entries.end())
     {
-      it->second->lock = false;
+      line_lock[it->second.slot] = false;
+      std::vector<Cache *> waiters = std::move(it->second.waiters);
       mshr_entries.erase(it);
+      for (auto hc : waiters)
+      {
+        hc->callback(req);
+      }
+      return;
     }
 
     if (higher_cache.size())
@@ -467,21 +638,88 @@ namespace ramulator
       lower_cache->tick();
 
     // if some pending memory request reside in retry list in cache, resend it again.
-    for (auto it = retry_list.begin(); it != retry_list.end(); it++)
+    for (auto it = retry_list.begin(); it != retry_list.end();)
+      it = lower_cache->access(*it, this) ? retry_list.erase(it) : std::next(it);
+  }
+
+  /* save or restore the cache contents, the lines of a set in the policy's victim order, each with its way and
+     followed by its policy state. A set restored in that order gives the same victim order again. */
+  void Cache::checkpoint(Checkpoint &cp)
+  {
+    assert(mshr_entries.empty() && retry_list.empty());
+    cp.expect(block_num, "cache sets");
+    cp.expect(assoc, "cache associativity");
+
+    uint64_t sets = 0;
+    for (unsigned int set = 0; set < block_num; set++)
+      sets += (set_size[set] > 0);
+    cp.io(sets);
+    if (cp.restoring)
     {
-      if (lower_cache->send(*it))
-        it = retry_list.erase(it);
+      for (unsigned int set = 0; set < block_num; set++)
+        for (unsigned int way = 0; way < assoc; way++)
+          if (line_tag[slot(set, way)] != EMPTY_TAG)
+            remove_line(set, way);
     }
+    int next = 0;
+    for (uint64_t i = 0; i < sets; i++)
+    {
+      while (!cp.restoring && set_size[next] == 0)
+        next++;
+      int index = next++;
+      cp.io(index);
+      uint64_t count = set_size[index];
+      cp.io(count);
+      std::vector<int> ways = cp.restoring ? std::vector<int>() : replacement->victims(index);
+      for (uint64_t j = 0; j < count; j++)
+      {
+        int way = cp.restoring ? 0 : ways[j];
+        cp.io(way);
+        long line = slot(index, way);
+        long addr = line_addr[line];
+        long tag = line_tag[line];
+        bool lock = line_lock[line];
+        bool dirty = line_dirty[line];
+        long coreId = line_core[line];
+        bool prefetched = line_prefetched[line];
+        cp.io(addr);
+        cp.io(tag);
+        cp.io(lock);
+        cp.io(dirty);
+        cp.io(coreId);
+        cp.io(prefetched);
+        if (cp.restoring)
+        {
+          fill_way(index, way, addr, lock, dirty, coreId);
+          line_prefetched[line] = prefetched;
+        }
+        replacement->checkpoint_line(cp, index, way);
+      }
+    }
+    replacement->checkpoint(cp);
+    if (prefetcher != nullptr)
+      prefetcher->checkpoint(cp);
+  }
+
+  /* queue a request for the memory system once its latency in the caches is met */
+  void CacheSystem::wait(long cycle, const Request& req) {
+    wait_list.push(cycle, req);
+    waiting[req.coreid]++;
   }
 
-  /* if any pending memory request exist in overall cache system. */
+  /* if any pending memory request of the core exist in overall cache system. */
   bool CacheSystem::is_wait_list_empty(long coreId) {
-    for (const auto& pair : wait_list) {
-        if (pair.second.coreid == coreId) {
-            return false;
-        }
-    }
-    return true;
+    auto pending = waiting.find(coreId);
+    return pending == waiting.end() || pending->second == 0;
+  }
+
+  /* the request lists are empty once drained, only the clock is saved */
+  void CacheSystem::checkpoint(Checkpoint &cp)
+  {
+    assert(wait_list.empty() && hit_list.empty());
+    cp.io(clk);
+    wait_list.restart(clk + 1);
+    hit_list.restart(clk + 1);
   }
 
   /* cachesys clock activation function */
@@ -491,35 +729,22 @@ namespace ramulator
     ++clk;
 
     // sends ready waiting request to memory.
-    auto it = wait_list.begin();
-    while (it != wait_list.end() && clk >= it->first)
-    {
-      if (!send_memory(it->second))
-      {
-        ++it;
-      }
-      else
-      {
-        debug_cache("complete req: addr %lx", (it->second).addr);
-        it = wait_list.erase(it);
-      }
-    }
+    wait_list.expire(clk, [this](Request &req)
+                     {
+                       if (!send_memory(req))
+                         return false;
+                       waiting[req.coreid]--;
+                       debug_cache("complete req: addr %lx", req.addr);
+                       return true;
+                     });
 
     // hit request callback.
-    it = hit_list.begin();
-    while (it != hit_list.end())
-    {
-      if (clk >= it->first)
-      {
-        it->second.callback(it->second);
-        debug_cache("finish hit: addr %lx", (it->second).addr);
-        it = hit_list.erase(it);
-      }
-      else
-      {
-        ++it;
-      }
-    }
+    hit_list.expire(clk, [](Request &req)
+                    {
+                      req.callback(req);
+                      debug_cache("finish hit: addr %lx", req.addr);
+                      return true;
+                    });
   }
 
 } // namespace ramulator
@@ -1,18 +1,25 @@
 #ifndef __CACHE_H
 #define __CACHE_H
 
+#include "Checkpoint.h"
 #include "Config.h"
+#include "Prefetcher.h"
+#include "ReplacementPolicy.h"
 #include "Request.h"
 #include "Statistics.h"
+#include "TimingWheel.h"
 #include <algorithm>
 #include <cstdio>
 #include <cassert>
 #include <functional>
+#include <iterator>
 #include <list>
 #include <map>
 #include <memory>
 #include <queue>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 namespace ramulator
 {
@@ -30,19 +37,6 @@ namespace ramulator
     } level;
     std::string level_string;
 
-    // cache line structure.
-    struct Line
-    {
-      long addr;
-      long tag;
-      bool lock; // when the lock is on, the value is not valid yet.
-      bool dirty;
-      long coreId;
-      Line(long addr, long tag) : addr(addr), tag(tag), lock(true), dirty(false) {}
-      Line(long addr, long tag, long coreId) : addr(addr), tag(tag), lock(true), dirty(false), coreId(coreId) {}
-      Line(long addr, long tag, bool lock, bool dirty, long coreId) : addr(addr), tag(tag), lock(lock), dirty(dirty), coreId(coreId) {}
-    };
-
     Cache(int size, int assoc, int block_size, int mshr_entry_num,
           Level level, std::shared_ptr<CacheSystem> cachesys, bool is_nmp);
 
@@ -78,9 +72,21 @@ namespace ramulator
     void tick();
     bool send(Request req);
     void concatlower(Cache *lower);
+
+    // a fill unlocks the line of its MSHR entry and goes on to the waiters of the entry only. Without an entry (a hit
+    // below the requester) it goes on to every higher cache.
     void callback(Request &req);
 
   protected:
+    // a miss being filled: the line it locked and the higher caches whose misses wait for it (the first one sent it,
+    // the others merged into it).
+    struct MSHR
+    {
+      long slot;
+      std::vector<Cache *> waiters;
+      bool prefetch = false;    // sent by the prefetcher of this cache, no demand miss merged into it yet
+    };
+
     bool is_first_level;
     bool is_last_level;
     size_t size;
@@ -104,7 +110,7 @@ namespace ramulator
     }
 
     // evict the cache line from higher level to this level.
-    // pass the dirty bit and update LRU queue.
+    // pass the dirty bit and update the replacement state.
     void evictline(long addr, bool dirty);
 
     // invalidate the line from this level to higher levels.
@@ -113,33 +119,33 @@ namespace ramulator
     // in higher level and this level.
     std::pair<long, bool> invalidate(long addr);
 
-    // evict the victim from current set of lines.
+    // evict the victim way from the set.
     // first do invalidation, then call evictline(L1 or L2) or send
     // a write request to memory(L3) when dirty bit is on.
-    void evict(std::list<Line> *lines, std::list<Line>::iterator victim);
+    void evict(int set, int victim);
 
     // first test whether need eviction, if so, do eviction by
     // calling evict function. Then allocate a new line and return
-    // the iterator points to it.
-    std::list<Line>::iterator allocate_line(std::list<Line> &lines, long addr, long coreId); //2406
+    // its way, -1 when every line of the set is still locked.
+    int allocate_line(int set, long addr, long coreId); //2406
 
     // check whether the set to hold addr has space or eviction is
     // needed.
-    bool need_eviction(const std::list<Line> &lines, long addr);
+    bool need_eviction(int set, long addr);
 
-    // Check whether this addr is hit and fill in the pos_ptr with
-    // the iterator to the hit line or lines.end()
-    bool is_hit(std::list<Line> &lines, long addr, std::list<Line>::iterator *pos_ptr);
+    // Check whether this addr is hit and fill in the way_ptr with
+    // the way of the hit line or -1
+    bool is_hit(int set, long addr, int *way_ptr);
 
-    bool all_sets_locked(const std::list<Line> &lines)
+    bool all_sets_locked(int set)
     {
-      if (lines.size() < assoc)
+      if (set_size[set] < assoc)
       {
         return false;
       }
-      for (const auto &line : lines)
+      for (unsigned int way = 0; way < assoc; way++)
       {
-        if (!line.lock)
+        if (!line_lock[slot(set, way)])
         {
           return false;
         }
@@ -149,68 +155,91 @@ namespace ramulator
 
     bool check_unlock(long addr)
     {
-      auto it = cache_lines.find(get_index(addr));
-      if (it == cache_lines.end())
+      int set = get_index(addr);
+      int way = find_way(set, get_tag(addr));
+      if (way < 0)
       {
         return true;
       }
       else
       {
-        auto &lines = it->second;
-        auto line = find_if(lines.begin(), lines.end(),
-                            [addr, this](Line l)
-                            { return (l.tag == get_tag(addr)); });
-        if (line == lines.end())
+        bool check = !line_lock[slot(set, way)];
+        if (!is_first_level)
         {
-          return true;
-        }
-        else
-        {
-          bool check = !line->lock;
-          if (!is_first_level)
+          for (auto hc : higher_cache)
           {
-            for (auto hc : higher_cache)
+            if (!check)
             {
-              if (!check)
-              {
-                return check;
-              }
-              check = check && hc->check_unlock(line->addr);
+              return check;
             }
+            check = check && hc->check_unlock(line_addr[slot(set, way)]);
           }
-          return check;
         }
+        return check;
       }
     }
 
-    std::vector<std::pair<long, std::list<Line>::iterator>>::iterator hit_mshr(long addr)
+    // request from the core (higher == nullptr) or from a higher cache, which waits on the MSHR entry of a miss.
+    bool access(Request req, Cache *higher);
+
+    // the sets are flat arrays preallocated for the whole cache, one array per field: way w of set s is at
+    // slot s * assoc + w. A line stays in its way until it leaves the set, the victims are chosen by the policy.
+    static const long EMPTY_TAG = -1;
+    std::vector<long> line_tag;             // EMPTY_TAG when the way holds no line
+    std::vector<long> line_addr;
+    std::vector<int> line_core;
+    std::vector<unsigned char> line_lock;   // when the lock is on, the value is not valid yet.
+    std::vector<unsigned char> line_dirty;
+    std::vector<unsigned char> line_prefetched; // filled by a prefetch of this cache, no demand hit yet
+    std::vector<unsigned short> set_size;   // lines held by each set
+    std::unique_ptr<ReplacementPolicy> replacement;
+    std::unique_ptr<Prefetcher> prefetcher; // nullptr without prefetching
+
+    long slot(int set, int way) const
     {
-      auto mshr_it =
-          find_if(mshr_entries.begin(), mshr_entries.end(),
-                  [addr, this](std::pair<long, std::list<Line>::iterator>
-                                   mshr_entry)
-                  {
-                    return (align(mshr_entry.first) == align(addr));
-                  });
-      return mshr_it;
+      return long(set) * assoc + way;
     }
 
-    std::list<Line> &get_lines(long addr)
+    // lowest way of the set holding the tag, -1 when absent. All ways are compared without an early exit and the
+    // tags, ways and result are all 64-bit lanes, so the loop vectorizes wherever 64-bit lanes compare in one
+    // instruction (-msse4.2, -mavx2, -march=native); plain x86-64 keeps it a branch-free scalar loop.
+    int find_way(int set, long tag) const
     {
-      if (cache_lines.find(get_index(addr)) == cache_lines.end())
-      {
-        cache_lines.insert(make_pair(get_index(addr),
-                                     std::list<Line>()));
-      }
-      return cache_lines[get_index(addr)];
+      const long *tags = &line_tag[slot(set, 0)];
+      long found = -1;
+      for (long way = long(assoc) - 1; way >= 0; way--)
+        found = (tags[way] == tag) ? way : found;
+      return int(found);
     }
-  
+
+    // put the line in a free way of the set, returns the way.
+    int insert_line(int set, long addr, bool lock, bool dirty, long coreId);
+    void fill_way(int set, int way, long addr, bool lock, bool dirty, long coreId);
+
+    // take the line out of the set.
+    void remove_line(int set, int way);
+
+    // the first line in the policy's order that no level holds locked, -1 when there is none. The policy is told
+    // the line is evicted.
+    int select_victim(int set);
+
+    // show a demand access the cache took to the prefetcher and send the lines it proposes.
+    void prefetch(const Request &req, bool miss, bool prefetch_hit);
+
+    // a prefetch, of this cache or from above, can take an MSHR entry: the last quarter is kept for the demand misses.
+    bool prefetch_room() const
+    {
+      return mshr_entries.size() + std::max(1u, mshr_entry_num / 4) < mshr_entry_num;
+    }
+
+    // warm() with the policy stats off
+    bool warm_line(long addr, bool write, long coreId);
+
   public:
     unsigned int index_mask;
     unsigned int index_offset;
     unsigned int tag_offset;
-    std::map<int, std::list<Line>> cache_lines;
-    std::vector<std::pair<long, std::list<Line>::iterator>> mshr_entries;
+    std::unordered_map<long, MSHR> mshr_entries;        // by aligned block address
     std::list<Request> retry_list;
     int get_index(long addr)
     {
@@ -222,9 +251,25 @@ namespace ramulator
       return (addr >> tag_offset);
     }
 
+    // whether the line holding addr is in this cache and dirty.
+    bool is_dirty(long addr)
+    {
+      int set = get_index(addr);
+      int way = find_way(set, get_tag(addr));
+      return way >= 0 && line_dirty[slot(set, way)];
+    }
+
     // bool flush_dirty_lines(long coreId);  // Not working ...
     void flush_line(long addr);
     void flush_all_dirty_lines();
+
+    // functional access of the fast-forward: the line is filled through the lower levels and is touched in the
+    // replacement policy, nothing is timed or counted. Locked lines are never evicted, false when the set had no other victim.
+    bool warm(long addr, bool write, long coreId);
+
+    // save or restore the lines in the policy's victim order and the policy state (drained, no MSHR or retry
+    // pending)
+    void checkpoint(Checkpoint& cp);
   };
 
   class CacheSystem
@@ -264,25 +309,42 @@ namespace ramulator
         first_level = Cache::Level::L1;
         last_level = Cache::Level::L1;
       }
+
+      replacement[int(Cache::Level::L1)] = configs.get_replacement_policy(is_nmp ? "mcp_l1_replacement" : "l1_replacement");
+      replacement[int(Cache::Level::L2)] = configs.get_replacement_policy("l2_replacement");
+      replacement[int(Cache::Level::L3)] = configs.get_replacement_policy("llc_replacement");
+      prefetcher[int(Cache::Level::L1)] = configs.get_prefetcher(is_nmp ? "mcp_l1_prefetcher" : "l1_prefetcher");
+      prefetcher[int(Cache::Level::L2)] = configs.get_prefetcher("l2_prefetcher");
+      prefetcher[int(Cache::Level::L3)] = configs.get_prefetcher("llc_prefetcher");
+      prefetch_degree = configs.get_prefetch_degree();
     }
 
-    // wait_list contains miss requests with their latencies in
-    // cache. When this latency is met, the send_memory function
-    // will be called to send the request to the memory system.
-    std::list<std::pair<long, Request>> wait_list;
+    // wait_list contains miss requests by the cycle their latency
+    // in cache is met. Then the send_memory function will be called
+    // to send the request to the memory system, a refused one is
+    // sent again at the next cycles before the later ones.
+    TimingWheel<Request> wait_list;
+    void wait(long cycle, const Request& req);
     bool is_wait_list_empty(long coreId);
+    std::unordered_map<long, int> waiting;    // wait_list entries of each core
 
-    // hit_list contains hit requests with their latencies in cache.
-    // callback function will be called when this latency is met and
+    // hit_list contains hit requests by the cycle their latency in
+    // cache is met. Then the callback function will be called and
     // set the instruction status to ready in processor's window.
-    std::list<std::pair<long, Request>> hit_list;
+    TimingWheel<Request> hit_list;
 
     std::function<bool(Request)> send_memory;
 
     long clk = 0;
     void tick();
+    void checkpoint(Checkpoint& cp);
     bool is_nmp = false;
 
+    // replacement policy and prefetcher of each level
+    std::string replacement[int(Cache::Level::MAX)];
+    std::string prefetcher[int(Cache::Level::MAX)];
+    int prefetch_degree;
+
     Cache::Level first_level;
     Cache::Level last_level;
   };
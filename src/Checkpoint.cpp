@@ -0,0 +1,151 @@
+#include "Checkpoint.h"
+#include "Config.h"
+#include "StatType.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+static const char MAGIC[8] = {'M', 'C', 'P', 'S', 'C', 'K', 'P', 'T'};
+
+/* open the image and write (or check) its magic and version */
+Checkpoint::Checkpoint(const string& path, bool restoring) : path(path), restoring(restoring)
+{
+    file = fopen(path.c_str(), restoring ? "rb" : "wb");
+    if (file == NULL)
+        fail(restoring ? "can not be opened" : "can not be created");
+
+    char magic[sizeof(MAGIC)];
+    memcpy(magic, MAGIC, sizeof(MAGIC));
+    uint32_t version = VERSION;
+    raw(magic, sizeof(magic));
+    raw(&version, sizeof(version));
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+        fail("not a checkpoint image");
+    if (version != VERSION)
+        fail("image version " + to_string(version) + ", this simulator reads version " + to_string(VERSION));
+}
+
+Checkpoint::~Checkpoint()
+{
+    if (file != NULL && fclose(file) != 0 && !restoring)
+        fail("write error");
+}
+
+void Checkpoint::fail(const string& why) const
+{
+    cerr << "Checkpoint " << path << ": " << why << endl;
+    exit(1);
+}
+
+void Checkpoint::raw(void* data, size_t size)
+{
+    if (restoring) {
+        if (fread(data, 1, size, file) != size)
+            fail("truncated image");
+    }
+    else if (fwrite(data, 1, size, file) != size)
+        fail("write error");
+}
+
+uint64_t Checkpoint::length(uint64_t size)
+{
+    io(size);
+    return size;
+}
+
+void Checkpoint::io(string& value)
+{
+    value.resize(length(value.size()));
+    if (!value.empty())
+        raw(&value[0], value.size());
+}
+
+void Checkpoint::io(vector<bool>& values)
+{
+    values.resize(length(values.size()));
+    for (size_t i = 0; i < values.size(); i++) {
+        bool value = values[i];
+        io(value);
+        values[i] = value;
+    }
+}
+
+/* the keys that decide the shape or the contents of the host and memory state: caches, page mapping, DRAM timing
+   and the trace positions. The MCP side, the limits and the mode can differ between the saving and the restoring run. */
+void Checkpoint::fingerprint(const Config& configs)
+{
+    static const char* keys[] = {
+        "standard", "stacks", "speed", "org", "maxblock", "link_width", "lane_speed", "source_mode_host_links",
+        "pass_thru_links", "payload_flits", "addressing_type", "translation", "unlimit_bandwidth", "no_DRAM_latency",
+        "core_org", "number_cores", "cpu_frequency", "cache", "mcp_cache", "consider_inst_fetching", "trace_input",
+        "trace_start_inst", "trace_start_region", "trace_start_region_instance", "memory_model", "l1_replacement",
+        "l2_replacement", "llc_replacement", "l1_prefetcher", "l2_prefetcher", "llc_prefetcher", "prefetch_degree"};
+
+    section("config");
+    uint64_t count = length(sizeof(keys) / sizeof(keys[0]));
+    for (uint64_t i = 0; i < count; i++) {
+        string key = restoring ? "" : keys[i];
+        string value = restoring ? "" : configs[key];
+        io(key);
+        io(value);
+        if (restoring && configs[key] != value)
+            fail("saved with " + key + " = \"" + value + "\", the config has \"" + configs[key] + "\"");
+    }
+}
+
+void Checkpoint::section(const char* name)
+{
+    string tag = name;
+    io(tag);
+    if (tag != name)
+        fail("expected section " + string(name) + ", found " + tag);
+}
+
+void Checkpoint::expect(long value, const char* what)
+{
+    long saved = value;
+    io(saved);
+    if (saved != value)
+        fail(string(what) + " is " + to_string(saved) + " in the image but " + to_string(value) + " here");
+}
+
+/* statistics are keyed by name and occurrence (the per-core caches share names), the elements of a vector are
+   saved with the vector. Statistics the restoring simulator does not have (other MCP side) are dropped. */
+void Checkpoint::stats()
+{
+    section("stats");
+    map<string, Stats::StatBase*> current;
+    map<string, int> seen;
+    for (auto stat : Stats::statlist.all()) {
+        if (stat == nullptr || stat->stat_name().compare(0, 1, "[") == 0)
+            continue;
+        current[stat->stat_name() + "#" + to_string(seen[stat->stat_name()]++)] = stat;
+    }
+
+    uint64_t count = 0;
+    if (!restoring)
+        for (auto& entry : current)
+            count += !entry.second->state().empty();
+    count = length(count);
+
+    auto next = current.begin();
+    for (uint64_t i = 0; i < count; i++) {
+        string key;
+        Stats::VCounter values;
+        if (!restoring) {
+            while (next->second->state().empty())
+                ++next;
+            key = next->first;
+            values = next->second->state();
+            ++next;
+        }
+        io(key);
+        io(values);
+        if (restoring && current.count(key))
+            current[key]->set_state(values);
+    }
+}
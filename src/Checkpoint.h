@@ -0,0 +1,131 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <utility>
+#include <type_traits>
+
+namespace ramulator
+{
+
+class Config;
+
+/*
+ * versioned binary image of the simulator state (--checkpoint-at / --restore). Every component describes its state
+ * once, in a checkpoint() member made of io() calls: they write the values when saving and read them back in the
+ * same order when restoring. Images are taken drained (nothing in flight), so no request or callback is saved.
+ */
+class Checkpoint
+{
+public:
+    static const uint32_t VERSION = 4;
+
+    Checkpoint(const std::string& path, bool restoring);
+    ~Checkpoint();
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    const std::string path;
+    const bool restoring;
+
+    void fingerprint(const Config& configs);    // the config keys shaping the saved state have to match on restore.
+    void section(const char* name);             // tag the next part of the image, checked on restore.
+    void expect(long value, const char* what);  // a size the restoring simulator has to have too.
+    void stats();                               // every statistic, matched by name (and occurrence) on restore.
+    void fail(const std::string& why) const;
+
+    template <typename T>
+    void io(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values are saved as they are");
+        raw(&value, sizeof(T));
+    }
+
+    void io(std::string& value);
+    void io(std::vector<bool>& values);
+
+    template <typename T>
+    void io(std::vector<T>& values)
+    {
+        values.resize(length(values.size()));
+        for (auto& value : values)
+            io(value);
+    }
+
+    template <typename T>
+    void io(std::deque<T>& values)
+    {
+        values.resize(length(values.size()));
+        for (auto& value : values)
+            io(value);
+    }
+
+    template <typename T>
+    void io(std::list<T>& values)
+    {
+        values.resize(length(values.size()));
+        for (auto& value : values)
+            io(value);
+    }
+
+    template <typename A, typename B>
+    void io(std::pair<A, B>& value)
+    {
+        io(value.first);
+        io(value.second);
+    }
+
+    template <typename T>
+    void io(std::set<T>& values)
+    {
+        uint64_t count = length(values.size());
+        if (!restoring) {
+            for (T value : values)
+                io(value);
+            return;
+        }
+        values.clear();
+        for (uint64_t i = 0; i < count; i++) {
+            T value;
+            io(value);
+            values.insert(value);
+        }
+    }
+
+    template <typename K, typename V>
+    void io(std::map<K, V>& values)
+    {
+        uint64_t count = length(values.size());
+        if (!restoring) {
+            for (auto& entry : values) {
+                K key = entry.first;
+                io(key);
+                io(entry.second);
+            }
+            return;
+        }
+        values.clear();
+        for (uint64_t i = 0; i < count; i++) {
+            K key;
+            io(key);
+            io(values[key]);
+        }
+    }
+
+private:
+    FILE* file;
+
+    void raw(void* data, size_t size);
+    uint64_t length(uint64_t size);             // element count of a container (the saved one on restore).
+};
+
+} /* namespace ramulator */
+
+#endif /* __CHECKPOINT_H */
@@ -7,6 +7,7 @@
 #include <map>
 #include <iostream>
 #include <cassert>
+#include <thread>
 
 namespace ramulator
 {
@@ -175,6 +176,215 @@ public:
       return (expected_limit_insts != 0);
     }
 
+    std::string get_trace_reader() const {
+      // the default value is mmap, stream keeps the FILE* reader (pipes always use it)
+      if (options.find("trace_reader") != options.end()) {
+        return (options.find("trace_reader"))->second;
+      }
+      return "mmap";
+    }
+
+    std::string get_trace_input() const {
+      // the default value is merged (one trace with every thread), per_thread reads <trace>.<core id> split by trace_split
+      if (options.find("trace_input") != options.end()) {
+        return (options.find("trace_input"))->second;
+      }
+      return "merged";
+    }
+
+    long get_trace_readahead_window() const {
+      // the default window is 64 MB, 0 leaves read-ahead to the kernel
+      if (options.find("trace_readahead_mb") != options.end()) {
+        return long(get_int_value("trace_readahead_mb")) << 20;
+      }
+      return 64l << 20;
+    }
+
+    long get_trace_start_inst() const {
+      // the default value is 0, i.e. the trace is simulated from its first record
+      if (options.find("trace_start_inst") != options.end()) {
+        return atol((options.find("trace_start_inst"))->second.c_str());
+      }
+      return 0;
+    }
+
+    long get_trace_start_region() const {
+      // the default value is -1, otherwise the trace starts at an ROI_BEGIN of this region
+      if (options.find("trace_start_region") != options.end()) {
+        return atol((options.find("trace_start_region"))->second.c_str());
+      }
+      return -1;
+    }
+
+    long get_trace_start_region_instance() const {
+      // the default value is 1 (first instance of trace_start_region)
+      if (options.find("trace_start_region_instance") != options.end()) {
+        return atol((options.find("trace_start_region_instance"))->second.c_str());
+      }
+      return 1;
+    }
+
+    long get_fast_forward_insts() const {
+      // host instructions executed functionally (caches and page mapping, no timing) before the warmup.
+      // The default value is 0, no fast-forward
+      if (options.find("fast_forward_insts") != options.end()) {
+        return atol((options.find("fast_forward_insts"))->second.c_str());
+      }
+      return 0;
+    }
+
+    long get_fast_forward_region() const {
+      // the default value is -1, otherwise the fast-forward runs up to an ROI_BEGIN of this region
+      if (options.find("fast_forward_region") != options.end()) {
+        return atol((options.find("fast_forward_region"))->second.c_str());
+      }
+      return -1;
+    }
+
+    long get_fast_forward_region_instance() const {
+      // the default value is 1 (first instance of fast_forward_region)
+      if (options.find("fast_forward_region_instance") != options.end()) {
+        return atol((options.find("fast_forward_region_instance"))->second.c_str());
+      }
+      return 1;
+    }
+
+    std::string get_replacement_policy(const std::string& key) const {
+      // replacement policy of a cache level (l1_replacement, l2_replacement, llc_replacement, mcp_l1_replacement):
+      // lru, random, srrip, drrip or ship. The default value is lru
+      if (options.find(key) != options.end()) {
+        return (options.find(key))->second;
+      }
+      return "lru";
+    }
+
+    std::string get_prefetcher(const std::string& key) const {
+      // prefetcher of a cache level (l1_prefetcher, l2_prefetcher, llc_prefetcher, mcp_l1_prefetcher): none,
+      // next_line, ip_stride or stream. The default value is none
+      if (options.find(key) != options.end()) {
+        return (options.find(key))->second;
+      }
+      return "none";
+    }
+
+    int get_prefetch_degree() const {
+      // lines a prefetcher proposes per trigger. The default value is 2
+      if (options.find("prefetch_degree") != options.end()) {
+        return get_int_value("prefetch_degree");
+      }
+      return 2;
+    }
+
+    long get_sample_period() const {
+      // sampled simulation of repeated ROI instances: after the first ones, every sample_period-th instance of a
+      // region is simulated in detail and the others are fast-forwarded. The default value is 0, every instance
+      if (options.find("sample_period") != options.end()) {
+        return atol((options.find("sample_period"))->second.c_str());
+      }
+      return 0;
+    }
+
+    long get_sample_first_instances() const {
+      // the default value is 2 (the first two instances of every region are simulated in detail)
+      if (options.find("sample_first_instances") != options.end()) {
+        return atol((options.find("sample_first_instances"))->second.c_str());
+      }
+      return 2;
+    }
+
+    std::string get_oracle_log() const {
+      // decisions of the Oracle mode, one line per evaluated ROI instance (the driver sets it to the stats file with .oracle)
+      if (options.find("oracle_log") != options.end()) {
+        return (options.find("oracle_log"))->second;
+      }
+      return "oracle.csv";
+    }
+
+    int get_trace_decode_threads() const {
+      // the default value is 2 chunks inflated ahead of the reader (chunked traces only)
+      if (options.find("trace_decode_threads") != options.end()) {
+        return get_int_value("trace_decode_threads");
+      }
+      return 2;
+    }
+
+    int get_trace_decode_workers() const {
+      // threads decoding the traces ahead of the cores, 0 decodes inline on the simulation thread
+      // the default value is 1, or 0 on a single-CPU host where the worker could only compete with the simulation
+      if (options.find("trace_decode_workers") != options.end()) {
+        return get_int_value("trace_decode_workers");
+      }
+      return std::thread::hardware_concurrency() > 1 ? 1 : 0;
+    }
+
+    int get_vault_tick_threads() const {
+      // threads ticking the vault controllers of a memory tick in parallel (the simulation thread included)
+      // the default value is 0, the vaults are ticked serially
+      if (options.find("vault_tick_threads") != options.end()) {
+        return get_int_value("vault_tick_threads");
+      }
+      return 0;
+    }
+
+    int get_sim_quantum() const {
+      // quantum of the parallel (bound-weave) engine in ns, the host and the NMP side tick a quantum apart on their own
+      // threads before the memory catches up. The default value is 0, the serial engine
+      if (options.find("sim_quantum_ns") != options.end()) {
+        return get_int_value("sim_quantum_ns");
+      }
+      return 0;
+    }
+
+    long get_checkpoint_at() const {
+      // warmup instruction count at which the state is saved (--checkpoint-at), the cores are drained first.
+      // The default value is 0, no checkpoint
+      if (options.find("checkpoint_at") != options.end()) {
+        return get_int_value("checkpoint_at");
+      }
+      return 0;
+    }
+
+    std::string get_checkpoint_file() const {
+      // image written at checkpoint_at (--checkpoint-file, the driver defaults it to the stats file with .ckpt)
+      if (options.find("checkpoint_file") != options.end()) {
+        return (options.find("checkpoint_file"))->second;
+      }
+      return "mcpsim.ckpt";
+    }
+
+    std::string get_restore_file() const {
+      // image the simulation continues from (--restore). The default value is "", a cold start
+      if (options.find("restore_file") != options.end()) {
+        return (options.find("restore_file"))->second;
+      }
+      return "";
+    }
+
+    std::string get_memory_model() const {
+      // Detailed runs the cycle-level memory, Analytical the queueing model calibrated on it. The default value is Detailed
+      if (options.find("memory_model") != options.end()) {
+        return (options.find("memory_model"))->second;
+      }
+      return "Detailed";
+    }
+
+    std::string get_analytical_calibration() const {
+      // fitted parameters of the analytical memory as printed by its calibration run.
+      // The default value is "", the calibration runs at the start of the simulation
+      if (options.find("analytical_calibration") != options.end()) {
+        return (options.find("analytical_calibration"))->second;
+      }
+      return "";
+    }
+
+    int get_trace_ring_entries() const {
+      // the default value is 4096 decoded lines buffered per trace
+      if (options.find("trace_ring_entries") != options.end()) {
+        return get_int_value("trace_ring_entries");
+      }
+      return 4096;
+    }
+
     bool record_cmd_trace() const {
       // the default value is false
       if (options.find("record_cmd_trace") != options.end()) {
@@ -1,6 +1,7 @@
 #ifndef __DRAM_H
 #define __DRAM_H
 
+#include "Checkpoint.h"
 #include "Statistics.h"
 #include <iostream>
 #include <vector>
@@ -94,6 +95,9 @@ public:
 
     void finish(long dram_cycles);
 
+    // save or restore the state and timing of the subtree
+    void checkpoint(Checkpoint& cp);
+
 private:
     // Constructor
     DRAM(){}
@@ -170,6 +174,27 @@ void DRAM<T>::regStats(const std::string& identifier) {
     }
 }
 
+template <typename T>
+void DRAM<T>::checkpoint(Checkpoint& cp) {
+    cp.expect(children.size(), "DRAM children");
+    cp.io(state);
+    cp.io(row_state);
+    cp.io(cur_clk);
+    for (int i = 0; i < int(T::Command::MAX); i++) {
+      cp.io(next[i]);
+      cp.io(prev[i]);
+    }
+    cp.io(cur_serving_requests);
+    cp.io(begin_of_serving);
+    cp.io(end_of_serving);
+    cp.io(begin_of_cur_reqcnt);
+    cp.io(begin_of_refreshing);
+    cp.io(end_of_refreshing);
+    cp.io(refresh_intervals);
+    for (auto child : children)
+      child->checkpoint(cp);
+}
+
 template <typename T>
 void DRAM<T>::finish(long dram_cycles) {
   // finalize busy cycles
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 
+#include "Checkpoint.h"
 #include "Controller.h"
 #include "Scheduler.h"
 
@@ -196,6 +197,17 @@ public:
     deque<Packet> response_packets_buffer;
     map<long, Packet> incoming_packets_buffer;
 
+    // activity-driven ticking: an idle controller is left out of Memory<HMC>::tick until its next refresh
+    long wake_clk = 0;              // tick at which a sleeping controller has to tick again, 0 while awake
+    function<long()> ticks_done;    // memory ticks this controller should have seen by now (set by Memory<HMC>)
+
+    // vault-parallel ticking: a tick run on a worker thread logs its updates of the shared (Memory<HMC>) stats
+    // and the NMP reads it served, Memory<HMC>::tick applies them in vault order once every worker is done
+    bool defer_shared = false;
+    vector<pair<ScalarStat*, Stats::Counter>> scalar_log;
+    vector<pair<Stats::Scalar*, Stats::Counter>> element_log;
+    vector<Request> served_reqs;
+
     // bool pim_mode_enabled = false;
     /* Constructor */
     Controller(const Config& configs, DRAM<HMC>* channel) :
@@ -665,6 +677,7 @@ public:
 
     bool enqueue(Request& req)
     {
+        wake();
 
         Queue& queue = get_queue(req.type);
         if(!req.from_nmp){
@@ -716,9 +729,9 @@ public:
     {
         // FIXME back to back command (add back-to-back buffer)
         clk++;
-        (*req_queue_length_sum) += readq.size() + writeq.size() + pending.size();
-        (*read_req_queue_length_sum) += readq.size() + pending.size();
-        (*write_req_queue_length_sum) += writeq.size();
+        add_shared(req_queue_length_sum, readq.size() + writeq.size() + pending.size());
+        add_shared(read_req_queue_length_sum, readq.size() + pending.size());
+        add_shared(write_req_queue_length_sum, writeq.size());
 
         /*** 1. Serve completed reads ***/
         if (pending.size()) {
@@ -732,7 +745,10 @@ public:
                 if (req.type == Request::Type::READ || req.type == Request::Type::WRITE) {
                   assert(incoming_packets_buffer.find(req.reqid) != incoming_packets_buffer.end());
                   incoming_packets_buffer.erase(req.reqid);
-                  req.callback(req);
+                  if (defer_shared)
+                    served_reqs.push_back(req);
+                  else
+                    req.callback(req);
                   pending.pop_front();
                }
             }
@@ -787,34 +803,34 @@ public:
           }
 
           if (req->type == Request::Type::READ) {
-            (*queueing_latency_sum) += clk - req->arrive;
+            add_shared(queueing_latency_sum, clk - req->arrive);
             if (is_row_hit(req)) {
-                ++(*read_row_hits)[coreid];
-                ++(*row_hits);
+                add_shared((*read_row_hits)[coreid], 1);
+                add_shared(row_hits, 1);
                 debug_hmc("row hit");
             } else if (is_row_open(req)) {
-                ++(*read_row_conflicts)[coreid];
-                ++(*row_conflicts);
+                add_shared((*read_row_conflicts)[coreid], 1);
+                add_shared(row_conflicts, 1);
                 debug_hmc("row conlict");
             } else {
-                ++(*read_row_misses)[coreid];
-                ++(*row_misses);
+                add_shared((*read_row_misses)[coreid], 1);
+                add_shared(row_misses, 1);
                 debug_hmc("row miss");
 
             }
-            (*read_transaction_bytes) += req->transaction_bytes;
+            add_shared(read_transaction_bytes, req->transaction_bytes);
           } else if (req->type == Request::Type::WRITE) {
             if (is_row_hit(req)) {
-                ++(*write_row_hits)[coreid];
-                ++(*row_hits);
+                add_shared((*write_row_hits)[coreid], 1);
+                add_shared(row_hits, 1);
             } else if (is_row_open(req)) {
-                ++(*write_row_conflicts)[coreid];
-                ++(*row_conflicts);
+                add_shared((*write_row_conflicts)[coreid], 1);
+                add_shared(row_conflicts, 1);
             } else {
-                ++(*write_row_misses)[coreid];
-                ++(*row_misses);
+                add_shared((*write_row_misses)[coreid], 1);
+                add_shared(row_misses, 1);
             }
-            (*write_transaction_bytes) += req->transaction_bytes;
+            add_shared(write_transaction_bytes, req->transaction_bytes);
           }
         }
 
@@ -849,6 +865,63 @@ public:
         }
     }
 
+    // The tick at which an idle controller has to be ticked again (its next refresh), 0 while it has work.
+    // Until then a tick would only advance the clocks and select the write mode.
+    long idle_until()
+    {
+        if (readq.size() || writeq.size() || otherq.size() || pending.size() || is_active())
+            return 0;
+        if (rowpolicy->type != RowPolicy<HMC>::Type::Opened && !rowtable->table.empty())
+            return 0;  // the speculative PRE may still close a row
+        return refresh->refreshed + channel->spec->speed_entry.nREFI;
+    }
+
+    // Catch up with the ticks skipped while sleeping
+    void wake()
+    {
+        if (!wake_clk)
+            return;
+        long skipped = ticks_done() - clk;
+        if (skipped > 0) {
+            clk += skipped;
+            refresh->clk += skipped;
+            write_mode = true;  // the read queue stayed empty
+        }
+        wake_clk = 0;
+    }
+
+    // Apply what a deferred tick logged, in the order the tick did it
+    void apply_shared()
+    {
+        for (auto& update : scalar_log)
+            (*update.first) += update.second;
+        for (auto& update : element_log)
+            (*update.first) += update.second;
+        for (auto& req : served_reqs)
+            req.callback(req);
+        scalar_log.clear();
+        element_log.clear();
+        served_reqs.clear();
+    }
+
+    // Save or restore the controller drained: the queues are empty, the clocks, open rows and bank timings are kept
+    void checkpoint(Checkpoint& cp)
+    {
+        assert(!readq.size() && !writeq.size() && !otherq.size() && pending.empty());
+        assert(response_packets_buffer.empty() && incoming_packets_buffer.empty());
+        if (with_drampower)
+            cp.fail("the DRAMPower state can not be saved (drampower_memspecs)");
+        cp.io(clk);
+        cp.io(write_mode);
+        cp.io(wake_clk);
+        cp.io(update_counter);
+        cp.io(rowtable->table);
+        cp.io(refresh->clk);
+        cp.io(refresh->refreshed);
+        cp.io(refresh->bank_ref_counters);
+        channel->checkpoint(cp);
+    }
+
     bool is_ready(list<Request>::iterator req)
     {
         typename HMC::Command cmd = get_first_cmd(req);
@@ -908,6 +981,22 @@ public:
     }
 
 private:
+    void add_shared(ScalarStat* stat, Stats::Counter value)
+    {
+        if (defer_shared)
+            scalar_log.emplace_back(stat, value);
+        else
+            (*stat) += value;
+    }
+
+    void add_shared(Stats::Scalar& stat, Stats::Counter value)
+    {
+        if (defer_shared)
+            element_log.emplace_back(&stat, value);
+        else
+            stat += value;
+    }
+
     typename HMC::Command get_first_cmd(list<Request>::iterator req)
     {
         typename HMC::Command cmd = channel->spec->translate[int(req->type)];
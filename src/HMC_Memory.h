@@ -6,13 +6,76 @@
 #include "LogicLayer.cpp"
 #include "Memory.h"
 #include "Packet.h"
+#include "PageAllocator.h"
 #include "Statistics.h"
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
 namespace ramulator
 {
 
+// Ticks a batch of vault controllers on vault_tick_threads threads, the caller being one of them.
+// Thread i ticks controllers i, i + threads, ... and tick() returns once the whole batch is done.
+class VaultTickPool
+{
+public:
+  VaultTickPool(int threads) : threads(threads), generation(0), done(0), stopping(false)
+  {
+    for (int i = 1; i < threads; i++)
+      workers.emplace_back(&VaultTickPool::run, this, i);
+  }
+
+  ~VaultTickPool()
+  {
+    stopping = true;
+    generation++;
+    for (auto& worker : workers)
+      worker.join();
+  }
+
+  void tick(const vector<Controller<HMC>*>& ctrls)
+  {
+    batch = &ctrls;
+    done.store(0, memory_order_relaxed);
+    generation.fetch_add(1, memory_order_release);
+    tick_share(0);
+    while (done.load(memory_order_acquire) != workers.size())
+      this_thread::yield();
+  }
+
+private:
+  unsigned int threads;
+  vector<thread> workers;
+  const vector<Controller<HMC>*>* batch = nullptr;
+  atomic<unsigned long> generation;
+  atomic<size_t> done;
+  atomic<bool> stopping;
+
+  void tick_share(unsigned int id)
+  {
+    for (size_t i = id; i < batch->size(); i += threads)
+      (*batch)[i]->tick();
+  }
+
+  // a memory tick is far too short to sleep on, the workers spin (yielding) until the next batch
+  void run(unsigned int id)
+  {
+    unsigned long seen = 0;
+    while (true) {
+      unsigned long now;
+      while ((now = generation.load(memory_order_acquire)) == seen)
+        this_thread::yield();
+      if (stopping)
+        return;
+      seen = now;
+      tick_share(id);
+      done.fetch_add(1, memory_order_release);
+    }
+  }
+};
+
 template<>
 class Memory<HMC, Controller> : public MemoryBase
 {
@@ -90,20 +153,7 @@ public:
       {"RoBaCoVa", Type::RoBaCoVa},
       {"RoCoBaBgVa", Type::RoCoBaBgVa}};
 
-    enum class Translation {
-      None,
-      Random,
-      MAX,
-    } translation = Translation::None;
-
-    std::map<string, Translation> name_to_translation = {
-      {"None", Translation::None},
-      {"Random", Translation::Random},
-    };
-
-    vector<int> free_physical_pages;
-    long free_physical_pages_remaining;
-    map<pair<int, long>, long> page_translation;
+    PageAllocator pages;    // virtual to physical pages of each core (translation)
 
     vector<list<int>> tags_pools;
 
@@ -114,9 +164,13 @@ public:
     vector<int> addr_bits;
     vector<int> requests_per_vault;
     int tx_bits;
+    unsigned int ticking_ctrl;  // index of the controller being ticked (ctrls.size() once the tick is done)
+    VaultTickPool* tick_pool = nullptr;         // vault-parallel ticking (vault_tick_threads > 1)
+    vector<Controller<HMC>*> awake_ctrls;       // controllers to tick this memory tick (parallel mode)
 
     Memory(const Config& configs, vector<Controller<HMC>*> ctrls)
-        : ctrls(ctrls),
+        : pages(memory_footprint, physical_page_replacement),
+          ctrls(ctrls),
           spec(ctrls[0]->channel->spec),
           addr_bits(int(HMC::Level::MAX))
     {
@@ -138,21 +192,19 @@ public:
           capacity_per_stack *= sz[lev];
         }
         max_address = capacity_per_stack * configs.get_stacks();
-        requests_per_vault.resize(32);
-        for(int i = 0; i < 32; i++) requests_per_vault[i] = 0;
+        ticking_ctrl = ctrls.size();
+        for (unsigned int i = 0; i < ctrls.size(); i++)
+          ctrls[i]->ticks_done = [this, i]() { return clk - (i >= ticking_ctrl ? 1 : 0); };
+        if (configs.get_vault_tick_threads() > 1) {
+          tick_pool = new VaultTickPool(min(configs.get_vault_tick_threads(), int(ctrls.size())));
+          for (auto ctrl : ctrls)
+            ctrl->defer_shared = true;
+        }
+        requests_per_vault.resize(ctrls.size(), 0);
         addr_bits[int(HMC::Level::MAX) - 1] -= calc_log2(spec->prefetch_size);
 
         // Initiating translation
-        if (configs.contains("translation")) {
-          translation = name_to_translation[configs["translation"]];
-        }
-        if (translation != Translation::None) {
-          // construct a list of available pages
-          // TODO: this should not assume a 4KB page!
-          free_physical_pages_remaining = max_address >> 12;
-
-          free_physical_pages.resize(free_physical_pages_remaining, -1);
-        }
+        pages.init(configs, max_address);
 
         // Initiating addressing
         if (configs.contains("addressing_type")) {
@@ -485,6 +537,7 @@ public:
 
     ~Memory()
     {
+        delete tick_pool;
         for (auto ctrl: ctrls)
             delete ctrl;
         delete spec;
@@ -504,10 +557,20 @@ public:
         clk++;
         num_dram_cycles++;
 
+        // idle controllers sleep until their next refresh or an incoming request (Controller::enqueue wakes them)
         bool is_active = false;
-        for (auto ctrl : ctrls) {
-          is_active = is_active || ctrl->is_active();
-          ctrl->tick();
+        if (tick_pool) {
+          tick_vaults_parallel(is_active);
+        } else {
+          for (ticking_ctrl = 0; ticking_ctrl < ctrls.size(); ticking_ctrl++) {
+            auto ctrl = ctrls[ticking_ctrl];
+            if (ctrl->wake_clk > clk)
+              continue;
+            ctrl->wake();
+            is_active = is_active || ctrl->is_active();
+            ctrl->tick();
+            ctrl->wake_clk = ctrl->idle_until();
+          }
         }
         if (is_active) {
           ramulator_active_cycles++;
@@ -517,6 +580,29 @@ public:
         }
     }
 
+    // The vault controllers only share the memory stats and the NMP read callbacks, which they log while
+    // ticking on the pool. Applying the logs in vault order afterwards gives exactly the serial results.
+    void tick_vaults_parallel(bool& is_active)
+    {
+        awake_ctrls.clear();
+        for (ticking_ctrl = 0; ticking_ctrl < ctrls.size(); ticking_ctrl++) {
+          auto ctrl = ctrls[ticking_ctrl];
+          if (ctrl->wake_clk > clk)
+            continue;
+          ctrl->wake();
+          is_active = is_active || ctrl->is_active();
+          awake_ctrls.push_back(ctrl);
+        }
+        if (awake_ctrls.size() > 1)
+          tick_pool->tick(awake_ctrls);
+        else if (awake_ctrls.size())
+          awake_ctrls[0]->tick();
+        for (auto ctrl : awake_ctrls) {
+          ctrl->apply_shared();
+          ctrl->wake_clk = ctrl->idle_until();
+        }
+    }
+
     int assign_tag(int slid) {
       if (tags_pools[slid].empty()) {
         return -1;
@@ -750,6 +836,7 @@ public:
       long dram_cycles = num_dram_cycles.value();
       long total_read_req = num_read_requests.total();
       for (auto ctrl : ctrls) {
+        ctrl->wake();
         ctrl->finish(dram_cycles);
       }
       read_bandwidth = read_transaction_bytes.value() * 1e9 / (dram_cycles * clk_ns());
@@ -773,62 +860,41 @@ public:
       //cout << "address bits: " << addr_bits[int(HMC::Level::Vault)] << endl;
     }
 
+    // Save or restore the memory drained: page mapping, link tags and the state of the links and the vaults
+    void checkpoint(Checkpoint& cp) {
+        cp.expect(ctrls.size(), "vault controllers");
+        cp.expect(logic_layers.size(), "stacks");
+        cp.io(clk);
+        cp.io(mem_req_count);
+        cp.io(requests_per_vault);
+        cp.io(tags_pools);
+
+        pages.checkpoint(cp);
+
+        for (auto logic_layer : logic_layers)
+          logic_layer->checkpoint(cp);
+        for (auto ctrl : ctrls)
+          ctrl->checkpoint(cp);
+    }
+
+    int get_vault_target(long addr) {
+        clear_higher_bits(addr, max_address - 1ll);
+        clear_lower_bits(addr, tx_bits);
+        int max_block_col_bits = spec->maxblock_entry.flit_num_bits - tx_bits;
+        slice_lower_bits(addr, max_block_col_bits);
+        return slice_lower_bits(addr, addr_bits[int(HMC::Level::Vault)]);
+    }
+
     long get_memory_transection_info() {
         return ((read_transaction_bytes.value() * 1e9) + (write_transaction_bytes.value() * 1e9));
     }
 
-    long page_allocator(long addr, int coreid) {
-        long virtual_page_number = addr >> 12;
-
-        switch(int(translation)) {
-            case int(Translation::None): {
-              return addr;
-            }
-            case int(Translation::Random): {
-                auto target = make_pair(coreid, virtual_page_number);
-                if(page_translation.find(target) == page_translation.end()) {
-                    // page doesn't exist, so assign a new page
-                    // make sure there are physical pages left to be assigned
-
-                    // if physical page doesn't remain, replace a previous assigned
-                    // physical page.
-                    memory_footprint += 1<<12;
-                    if (!free_physical_pages_remaining) {
-                      physical_page_replacement++;
-                      long phys_page_to_read = lrand() % free_physical_pages.size();
-                      assert(free_physical_pages[phys_page_to_read] != -1);
-                      page_translation[target] = phys_page_to_read;
-                    } else {
-                        // assign a new page
-                        long phys_page_to_read = lrand() % free_physical_pages.size();
-                        // if the randomly-selected page was already assigned
-                        if(free_physical_pages[phys_page_to_read] != -1) {
-                            long starting_page_of_search = phys_page_to_read;
-
-                            do {
-                                // iterate through the list until we find a free page
-                                // TODO: does this introduce serious non-randomness?
-                                ++phys_page_to_read;
-                                phys_page_to_read %= free_physical_pages.size();
-                            }
-                            while((phys_page_to_read != starting_page_of_search) && free_physical_pages[phys_page_to_read] != -1);
-                        }
-
-                        assert(free_physical_pages[phys_page_to_read] == -1);
-
-                        page_translation[target] = phys_page_to_read;
-                        free_physical_pages[phys_page_to_read] = coreid;
-                        --free_physical_pages_remaining;
-                    }
-                }
-
-                // TODO: page size should not always be fixed to 4KB
-                return (page_translation[target] << 12) | (addr & ((1 << 12) - 1));
-            }
-            default:
-                assert(false);
-        }
+    double get_transaction_bytes() {
+        return read_transaction_bytes.value() + write_transaction_bytes.value();
+    }
 
+    long page_allocator(long addr, int coreid) {
+        return pages.translate(addr, coreid);
     }
 
 
@@ -858,14 +924,6 @@ public:
     void clear_higher_bits(long& addr, long mask) {
         addr = (addr & mask);
     }
-private:
-    long lrand(void) {
-        if(sizeof(int) < sizeof(long)) {
-            return static_cast<long>(rand()) << (sizeof(int) * 8) | rand();
-        }
-
-        return rand();
-    }
 };
 
 } /*namespace ramulator*/
@@ -97,6 +97,7 @@ void Switch<T>::tick() {
       }
       auto ctrl = vault_ctrls[vault_id];
       if(ctrl->receive(packet)) {
+        link->master.wake(clk);
         link->slave.extracted_token_count += packet.total_flits;
         link->slave.input_buffer.pop_front();
         debug_hmc("extracted_token_count %d", link->slave.extracted_token_count);
@@ -126,6 +127,7 @@ void Switch<T>::tick() {
       continue; // This port has been occupied in this cycle
     }
     if (packet.total_flits <= link->master.available_space()) {
+      link->master.wake(clk);
       link->master.output_buffer.push_back(packet);
       vault_ctrl->response_packets_buffer.pop_front();
       used_links.insert(slid);
@@ -135,14 +137,36 @@ void Switch<T>::tick() {
 
 template<typename T>
 void LogicLayer<T>::tick() {
+  // idle link masters sleep, the switch wakes them when it hands them work
   for (auto link : host_links) {
-    link->master.tick();
+    if (!link->master.sleeping) {
+      link->master.tick();
+      link->master.sleeping = link->master.idle();
+    }
   }
   for (auto link : pass_thru_links) {
-    link->master.tick();
+    if (!link->master.sleeping) {
+      link->master.tick();
+      link->master.sleeping = link->master.idle();
+    }
   }
   xbar.tick();
 }
 
+// the link buffers are empty once drained, the clocks and flow control tokens are kept
+template<typename T>
+void LogicLayer<T>::checkpoint(Checkpoint& cp) {
+  cp.expect(host_links.size(), "host links");
+  cp.io(xbar.clk);
+  for (auto link : host_links) {
+    assert(link->slave.input_buffer.empty() && link->master.output_buffer.empty());
+    cp.io(link->slave.extracted_token_count);
+    cp.io(link->master.available_token_count);
+    cp.io(link->master.clk);
+    cp.io(link->master.next_packet_clk);
+    cp.io(link->master.sleeping);
+  }
+}
+
 } /* namespace ramulator */
 #endif /*__LOGICLAYER_CPP*/
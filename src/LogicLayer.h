@@ -1,11 +1,13 @@
 #ifndef __LOGICLAYER_H
 #define __LOGICLAYER_H
 
+#include "Checkpoint.h"
 #include "Config.h"
 #include "Packet.h"
 #include "HMC_Controller.h"
 #include "Memory.h"
 
+#include <cmath>
 #include <memory>
 #include <vector>
 
@@ -28,6 +30,7 @@ class LinkMaster {
   int available_token_count; // available token count on the other side
   long clk = 0;
   long next_packet_clk = 0;
+  bool sleeping = false; // idle, left out of LogicLayer::tick until the switch hands it a packet or tokens
 
   LinkMaster(const Config& configs, function<void(Packet&)> receive_from_link,
       Link<T>* link, LogicLayer<T>* logic_layer):
@@ -47,6 +50,24 @@ class LinkMaster {
       send();
     }
   }
+
+  // nothing to send but NULL packets
+  bool idle() {
+    return output_buffer.empty() && link->slave.extracted_token_count == 0;
+  }
+
+  // catch up with the ticks skipped while sleeping, only the NULL packets kept the link busy
+  void wake(long now) {
+    if (!sleeping) {
+      return;
+    }
+    sleeping = false;
+    if (next_packet_clk <= now) {
+      long null_packet_clks = ceil(logic_layer->one_flit_cycles);
+      next_packet_clk += null_packet_clks * ((now - next_packet_clk) / null_packet_clks + 1);
+    }
+    clk = now;
+  }
  private:
   // returns 0 if val == 0
   // returns 1<<leftmostbit if val > 0
@@ -158,6 +179,7 @@ class LogicLayer {
   }
 
   void tick();
+  void checkpoint(Checkpoint& cp);
 };
 
 } /* namespace ramulator */
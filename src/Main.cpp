@@ -5,6 +5,7 @@
 #include "HMC_Controller.h"
 #include "Memory.h"
 #include "HMC_Memory.h"
+#include "AnalyticalMemory.h"
 #include "DRAM.h"
 #include "Statistics.h"
 #include <algorithm>
@@ -14,6 +15,10 @@
 #include <stdlib.h>
 #include <functional>
 #include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <boost/program_options.hpp>
 
 /* Standards */
@@ -36,22 +41,186 @@ using namespace std;
 using namespace ramulator;
 namespace po = boost::program_options;
 
-static int gcd(int u, int v) {
-  if (v > u) {
-    swap(u,v);
+/* a clock domain of the simulation, ticking every period ps (the first tick at period - 1) */
+struct ClockDomain {
+  long period;
+  long next;
+  ClockDomain(long period) : period(period), next(period - 1) {}
+};
+
+/*
+ * next-event scheduler over any number of clock domains: it jumps straight to the earliest next tick instead of
+ * stepping through every gcd tick of the periods. Domains due at the same time tick in the order they were added,
+ * a tick returning true ends the run immediately, done() is checked after every time step.
+ */
+class ClockScheduler {
+ private:
+  struct Entry {
+    ClockDomain* domain;
+    function<bool()> tick;
+  };
+  vector<Entry> entries;
+
+  long next_time() const {
+    long next = entries[0].domain->next;
+    for (auto& entry : entries)
+      next = min(next, entry.domain->next);
+    return next;
   }
-  while (v != 0) {
-    int r = u % v;
-    u = v;
-    v = r;
+
+  // tick the domains due at the earliest next tick, true when one of them ends the run
+  bool step() {
+    now = next_time();
+    for (auto& entry : entries) {
+      if (entry.domain->next != now)
+        continue;
+      entry.domain->next += entry.domain->period;
+      if (entry.tick())
+        return true;
+    }
+    return false;
   }
-  return u;
-}
 
-static int gcd_ThreeNumbers(int a, int b, int c) {
-    return gcd(gcd(a, b), c);
+ public:
+  long now = 0;  // time of the step in progress
+
+  void add(ClockDomain& domain, function<bool()> tick) { entries.push_back({&domain, tick}); }
+
+  void run(function<bool()> done = nullptr) {
+    while (!step()) {
+      if (done && done())
+        return;
+    }
+  }
+
+  // tick everything due up to (and including) time end, for the quantum engine which ignores the tick results
+  void run_until(long end) {
+    while (next_time() <= end)
+      step();
+  }
+};
+
+/* memory requests sent by one thread of the quantum engine, held back until the weave phase replays the quantum */
+struct RequestOutbox {
+  struct Entry {
+    long time;
+    int rank;   // order of the sending domain among those ticking at the same time in the serial engine
+    Request req;
+  };
+  deque<Entry> entries;
+  long time = 0;  // stamped on the requests of the tick in progress
+  int rank = 0;
+  bool refused = false;  // the memory refused the head request at the end of the last weave, the side gets refused too
+
+  bool push(const Request& req) {
+    if (refused)
+      return false;
+    entries.push_back({time, rank, req});
+    return true;
+  }
+  bool ready(long now) const { return !entries.empty() && entries.front().time <= now; }
+  bool before(const RequestOutbox& other) const {
+    const Entry& a = entries.front();
+    const Entry& b = other.entries.front();
+    return a.time < b.time || (a.time == b.time && a.rank < b.rank);
+  }
+};
+
+/* hand the requests sent up to now to the memory in send order, a rejected request holds back the rest of its outbox */
+template <typename M>
+void deliver_requests(vector<RequestOutbox*>& outboxes, long now, M& memory) {
+  vector<bool> blocked(outboxes.size(), false);
+  while (true) {
+    int next = -1;
+    for (unsigned int i = 0; i < outboxes.size(); i++) {
+      if (!blocked[i] && outboxes[i]->ready(now) && (next < 0 || outboxes[i]->before(*outboxes[next])))
+        next = i;
+    }
+    if (next < 0)
+      break;
+    if (memory.send(outboxes[next]->entries.front().req))
+      outboxes[next]->entries.pop_front();
+    else
+      blocked[next] = true;
+  }
+  for (unsigned int i = 0; i < outboxes.size(); i++)
+    outboxes[i]->refused = blocked[i];
 }
 
+/*
+ * quantum-parallel engine (bound-weave): every side runs one quantum on its own thread (the first on the calling
+ * thread), then weave() replays the memory over the quantum and applies what the sides held back for each other.
+ * The sides only meet at the boundaries, so a memory response or a hand-over between sides is at most a quantum
+ * late. done() is checked at every boundary.
+ */
+class QuantumEngine {
+ private:
+  long quantum;
+  long end = 0;
+  mutex lock;
+  condition_variable started, finished;
+  unsigned long generation = 0;
+  unsigned int running = 0;
+  bool stopping = false;
+
+  void run_side(ClockScheduler* side) {
+    unsigned long seen = 0;
+    while (true) {
+      long until;
+      {
+        unique_lock<mutex> guard(lock);
+        started.wait(guard, [&]() { return stopping || generation != seen; });
+        if (stopping)
+          return;
+        seen = generation;
+        until = end;
+      }
+      side->run_until(until);
+      lock_guard<mutex> guard(lock);
+      if (--running == 0)
+        finished.notify_one();
+    }
+  }
+
+ public:
+  long quanta = 0;
+
+  QuantumEngine(long quantum) : quantum(quantum) {}
+
+  void run(const vector<ClockScheduler*>& sides, function<void(long)> weave, function<bool()> done) {
+    vector<thread> threads;
+    for (unsigned int i = 1; i < sides.size(); i++)
+      threads.emplace_back(&QuantumEngine::run_side, this, sides[i]);
+
+    while (true) {
+      {
+        lock_guard<mutex> guard(lock);
+        end += quantum;
+        running = sides.size() - 1;
+        generation++;
+      }
+      started.notify_all();
+      sides[0]->run_until(end);
+      {
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [&]() { return running == 0; });
+      }
+      weave(end);
+      quanta++;
+      if (done())
+        break;
+    }
+
+    {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+    }
+    started.notify_all();
+    for (auto& thread : threads)
+      thread.join();
+  }
+};
+
 class OutstandingReqWindow {
  private:
   int inflight_req = 0;
@@ -76,29 +245,120 @@ class OutstandingReqWindow {
   }
 };
 
-template <typename T>
-void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const std::vector<string>& files)
+/* save the state into a checkpoint image or load it back, both in the same order. Images are taken during the
+   warmup, so only the host side and the memory have run: the MCP sides start cold either way. */
+template <typename M>
+void checkpoint_state(const Config& configs, Checkpoint& cp, ClockDomain& cpu_clock, ClockDomain& mem_clock,
+                      M& memory, Processor& proc)
 {
-    // time unit is ps. setup the clock tick for entire simulation.
-    int cpu_tick = configs.get_cpu_tick();
-    int nmp_tick = configs.get_nmp_tick();
-    int mem_tick = memory.clk_ns() * 1000;
-    int tick_gcd = gcd_ThreeNumbers(cpu_tick, nmp_tick, mem_tick);
-    // printf("tick_gcd: %d\n", tick_gcd);
-    cpu_tick /= tick_gcd;
-    // printf("cpu_tick: %d\n", cpu_tick);
-    nmp_tick /= tick_gcd;
-    // printf("mcp_tick: %d\n", nmp_tick);
-    mem_tick /= tick_gcd;
-    // printf("mem_tick: %d\n", mem_tick);
-    long next_cpu_tick = cpu_tick - 1;
-    long next_nmp_tick = nmp_tick - 1;
-    long next_mem_tick = mem_tick - 1;
-
-    auto send = bind(&Memory<T, Controller>::send, &memory, placeholders::_1);         // bind the send function with mmeory.
-    Processor proc(configs, files, send, memory, false);                               // create CPU processor.
-    Processor nmp_proc(configs, files, send, memory, true);                            // create memory side MCP PUs. (i.e., NMP)
-    Processor nlp_proc(configs, files, send, memory, true, &proc.llc, proc.cachesys);  // create LLC side MCP PUs. (i.e., NLP)
+    cp.fingerprint(configs);
+    cp.section("clock");
+    cp.io(cpu_clock.next);
+    cp.io(mem_clock.next);
+    cp.io(Stats::curTick);
+    cp.section("memory");
+    memory.checkpoint(cp);
+    cp.section("host");
+    proc.checkpoint(cp);
+    cp.stats();
+}
+
+template <typename M>
+void finish_run(const Config& configs, M& memory, Processor& proc, Processor& nmp_proc, Processor& nlp_proc)
+{
+    // Calculate stats.
+    proc.calc_stats();
+    if (configs.get_simulation_mode() != "Host-Only") nmp_proc.calc_stats();
+    if (configs.get_simulation_mode() != "Host-Only" && configs.get_nlp_facility() == "on") nlp_proc.calc_stats();
+
+    // This a workaround for statistics set only initially lost in the end
+    memory.finish();
+    Stats::statlist.printall();
+}
+
+/* the main loop on the quantum engine: the host side (CPU and NLP PUs) and the NMP side tick apart for a quantum,
+   then the memory catches up with the requests they sent and the sides exchange their held-back actions */
+template <typename M>
+void run_quantum_engine(long quantum, ClockDomain& cpu_clock, ClockDomain& nmp_clock, ClockDomain& mem_clock,
+                        M& memory, Processor& proc, Processor& nmp_proc, Processor& nlp_proc,
+                        RequestOutbox& host_outbox, RequestOutbox& nmp_outbox, bool& quantum_running, bool nlp_on,
+                        function<bool()> done)
+{
+    // the serial engine ticks CPU, NMP, NLP and memory in this order when they are due at the same time.
+    ClockDomain nlp_clock = nmp_clock;
+    ClockScheduler host_side, nmp_side, weave_side;
+    host_side.add(cpu_clock, [&]() {
+        host_outbox.time = host_side.now;
+        host_outbox.rank = 0;
+        proc.tick();
+        Stats::curTick++;
+        return false;
+    });
+    if (nlp_on) {
+      host_side.add(nlp_clock, [&]() {
+          host_outbox.time = host_side.now;
+          host_outbox.rank = 2;
+          nlp_proc.tick();
+          return false;
+      });
+    }
+    nmp_side.add(nmp_clock, [&]() {
+        nmp_outbox.time = nmp_side.now;
+        nmp_outbox.rank = 1;
+        nmp_proc.tick();
+        return false;
+    });
+
+    vector<RequestOutbox*> outboxes = {&host_outbox, &nmp_outbox};
+    weave_side.add(mem_clock, [&]() {
+        deliver_requests(outboxes, weave_side.now, memory);
+        memory.tick();
+        return false;
+    });
+
+    Processor* sides[] = {&proc, &nmp_proc, &nlp_proc};
+    for (auto side : sides)
+      side->publish();
+    nmp_proc.detached = true;
+    quantum_running = true;
+
+    QuantumEngine engine(quantum);
+    engine.run({&host_side, &nmp_side}, [&](long end) {
+        weave_side.run_until(end);
+        for (auto side : sides)
+          side->apply_inbox();
+        for (auto side : sides)
+          side->publish();
+    }, done);
+
+    quantum_running = false;
+    nmp_proc.detached = false;
+    printf("Quantum engine: %ld quanta of %ld ns\n", engine.quanta, quantum / 1000);
+}
+
+template <typename M>
+void run_cputrace(const Config& configs, M& memory, const std::vector<string>& files,
+                  function<void()> built)
+{
+    // time unit is ps. setup the clock domains of the entire simulation.
+    ClockDomain cpu_clock(configs.get_cpu_tick());
+    ClockDomain nmp_clock(configs.get_nmp_tick());
+    ClockDomain mem_clock(long(memory.clk_ns() * 1000));
+
+    // the quantum engine runs the host (with the NLP PUs, which share its LLC) and the NMP PUs on their own threads.
+    long quantum = configs.get_sim_quantum() * 1000;
+    if (quantum > 0 && configs.get_simulation_mode() == "Host-Only") {
+      printf("The quantum engine needs the MCP side, Host-Only runs on the serial engine.\n");
+      quantum = 0;
+    }
+    bool quantum_running = false;
+    RequestOutbox host_outbox, nmp_outbox;
+    auto host_send = [&](Request req) { return quantum_running ? host_outbox.push(req) : memory.send(req); };
+    auto nmp_send = [&](Request req) { return quantum_running ? nmp_outbox.push(req) : memory.send(req); };
+
+    Processor proc(configs, files, host_send, memory, false);                               // create CPU processor.
+    Processor nmp_proc(configs, files, nmp_send, memory, true);                             // create memory side MCP PUs. (i.e., NMP)
+    Processor nlp_proc(configs, files, host_send, memory, true, &proc.llc, proc.cachesys);  // create LLC side MCP PUs. (i.e., NLP)
 
     proc.nmp_proc = &nmp_proc;                  // initiate NMP side processors to CPU processor.
     proc.nlp_proc = &nlp_proc;
@@ -109,26 +369,62 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
     nlp_proc.nmp_proc = &nmp_proc;
     nmp_proc.init_nlp_side();
     nlp_proc.init_nmp_side();
+    if (built) built();    // a sweep waits for every simulator to open its traces before any of them runs.
+
+    if (configs.get_restore_file() != "") {
+      Checkpoint cp(configs.get_restore_file(), true);
+      checkpoint_state(configs, cp, cpu_clock, mem_clock, memory, proc);
+      printf("Restored %s at instruction %ld (cycle %ld)\n", cp.path.c_str(), proc.get_executed_insts(), long(Stats::curTick));
+    }
+
+    // the fast-forward warms the caches and the page mapping functionally, a restored image is warm already.
+    long fast_forward_insts = configs.get_fast_forward_insts();
+    long fast_forward_region = configs.get_fast_forward_region();
+    if (configs.get_restore_file() == "" && (fast_forward_insts > 0 || fast_forward_region >= 0)) {
+      long insts = proc.fast_forward(fast_forward_insts, fast_forward_region, configs.get_fast_forward_region_instance());
+      printf("Fast-forwarded %ld instructions.\n", insts);
+      if (proc.has_reached_limit())
+        printf("WARNING: The end of the input trace file was reached during the fast-forward.\n");
+    }
+
+    // a checkpoint waits for the host side to drain, the warmup goes on until it is written.
+    long checkpoint_at = configs.get_checkpoint_at();
+    bool checkpoint_pending = (checkpoint_at > proc.get_executed_insts());
+    long drain_cycles = 0;
 
-    bool is_warming_up = (configs.get_warmup_insts() != 0);
-    for(long i = 0; is_warming_up; i++) {
-      if (i == next_cpu_tick) {            
-        next_cpu_tick += cpu_tick;
+    bool is_warming_up = (proc.get_executed_insts() < configs.get_warmup_insts());
+    if (is_warming_up) {
+      ClockScheduler warmup;
+      warmup.add(cpu_clock, [&]() {
         proc.tick();
         Stats::curTick++;
-        is_warming_up = true;
-        if(proc.get_executed_insts() >= configs.get_warmup_insts()) is_warming_up = false;
-        
+        if (checkpoint_pending && proc.get_executed_insts() >= checkpoint_at) {
+          proc.draining = true;
+          if (proc.drained()) {
+            Checkpoint cp(configs.get_checkpoint_file(), false);
+            checkpoint_state(configs, cp, cpu_clock, mem_clock, memory, proc);
+            printf("Checkpoint %s written at instruction %ld (cycle %ld)\n", cp.path.c_str(), proc.get_executed_insts(), long(Stats::curTick));
+            proc.draining = false;
+            checkpoint_pending = false;
+          }
+          else if (++drain_cycles > 1000000) {
+            printf("The host side did not drain for the checkpoint in %ld cycles.\n", drain_cycles - 1);
+            exit(1);
+          }
+        }
+        if (!checkpoint_pending && proc.get_executed_insts() >= configs.get_warmup_insts()) is_warming_up = false;
+
         if (proc.has_reached_limit()) {
             printf("WARNING: The end of the input trace file was reached during warmup. Consider changing warmup_insts in the config file.\n");
-            break;
+            return true;
         }
-      }
-
-      if (i == next_mem_tick) {
-          next_mem_tick += mem_tick;
-          memory.tick();
-      }
+        return false;
+      });
+      warmup.add(mem_clock, [&]() {
+        memory.tick();
+        return false;
+      });
+      warmup.run([&]() { return !is_warming_up; });
     }
 
     printf("Warmup complete! ");
@@ -138,56 +434,67 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
     proc.warmedup_activate();
     printf("Starting the simulation...\n");
 
-    for (long i = 0; ; i++) {
-        if (i == next_cpu_tick) {            
-            next_cpu_tick += cpu_tick;
-            proc.tick();
-            Stats::curTick++; // processor clock, global, for Statistics
-
-            if (configs.calc_weighted_speedup()) {
-                if (proc.has_reached_limit() || proc.finished()) {
-                   if ((proc.is_complete()) && (nmp_proc.is_complete()) && (nlp_proc.is_complete())) break;
-                }
-            }
-            else{
-                if (configs.is_early_exit()) {
-                    if (proc.finished())
-                        break;
-                }
-                else {
-                    if (proc.finished() && nmp_proc.finished() && nlp_proc.finished() && (proc.is_complete()) && (nmp_proc.is_complete()) && (nlp_proc.is_complete())){
-                         break;
-                    }
-                }
+    bool weighted_speedup = configs.calc_weighted_speedup();
+    bool early_exit = configs.is_early_exit();
+    bool nlp_on = (configs.get_nlp_facility() == "on");
+    auto all_complete = [&]() {
+        return proc.finished() && nmp_proc.finished() && nlp_proc.finished() && (proc.is_complete()) && (nmp_proc.is_complete()) && (nlp_proc.is_complete());
+    };
+
+    auto host_done = [&]() {
+        if (weighted_speedup) {
+            if (proc.has_reached_limit() || proc.finished()) {
+               if ((proc.is_complete()) && (nmp_proc.is_complete()) && (nlp_proc.is_complete())) return true;
             }
         }
-
-        if(i == next_nmp_tick && configs.get_simulation_mode() != "Host-Only") {
-          next_nmp_tick += nmp_tick;
-          nmp_proc.tick();
-          if (configs.get_nlp_facility() == "on") nlp_proc.tick();
-          if (proc.finished() && nmp_proc.finished() && nlp_proc.finished() && (proc.is_complete()) && (nmp_proc.is_complete()) && (nlp_proc.is_complete())) break;
+        else if (early_exit) {
+            if (proc.finished())
+                return true;
         }
-
-        if (i == next_mem_tick) {
-            next_mem_tick += mem_tick;
-            memory.tick();
+        else if (all_complete()) {
+            return true;
         }
+        return false;
+    };
+
+    if (quantum > 0) {
+      run_quantum_engine(quantum, cpu_clock, nmp_clock, mem_clock, memory, proc, nmp_proc, nlp_proc,
+                         host_outbox, nmp_outbox, quantum_running, nlp_on,
+                         [&]() { return host_done() || all_complete(); });
+      finish_run(configs, memory, proc, nmp_proc, nlp_proc);
+      return;
     }
 
-    // Calculate stats.
-    proc.calc_stats();
-    if (configs.get_simulation_mode() != "Host-Only") nmp_proc.calc_stats();
-    if (configs.get_simulation_mode() != "Host-Only" && configs.get_nlp_facility() == "on") nlp_proc.calc_stats();
+    ClockScheduler scheduler;
+    scheduler.add(cpu_clock, [&]() {
+        proc.tick();
+        Stats::curTick++; // processor clock, global, for Statistics
+        return host_done();
+    });
+
+    // the memory side MCP PUs have no clock in Host-Only mode.
+    if (configs.get_simulation_mode() != "Host-Only") {
+        scheduler.add(nmp_clock, [&]() {
+            nmp_proc.tick();
+            if (nlp_on) nlp_proc.tick();
+            return all_complete();
+        });
+    }
 
-    // This a workaround for statistics set only initially lost in the end
-    memory.finish();
-    Stats::statlist.printall();
+    scheduler.add(mem_clock, [&]() {
+        memory.tick();
+        return false;
+    });
+
+    scheduler.run();
+    if (proc.oracle_fd >= 0)
+      proc.oracle_report();    // an Oracle branch whose instance outlasted the run.
+    finish_run(configs, memory, proc, nmp_proc, nlp_proc);
 }
 
 // template of start_run, it can be extended to other memory type.
 template<typename T>
-void start_run(const Config& configs, T* spec, const vector<string>& files) {
+void start_run(const Config& configs, T* spec, const vector<string>& files, function<void()> built = nullptr) {
   // initiate controller and memory
   int C = configs.get_channels(), R = configs.get_ranks();
   // Check and Set channel, rank number
@@ -205,15 +512,16 @@ void start_run(const Config& configs, T* spec, const vector<string>& files) {
 
   assert(files.size() != 0);
   if (configs["trace_type"] == "CPU") {
-    run_cputrace(configs, memory, files);
+    run_cputrace(configs, memory, files, built);
   } 
   else {
     cout << "Trace type should be CPU type." << endl ;
+    if (built) built();
   }
 }
 
-template<>
-void start_run<HMC>(const Config& configs, HMC* spec, const vector<string>& files) {
+/* the vault controllers of an HMC memory */
+vector<Controller<HMC>*> hmc_vault_ctrls(const Config& configs, HMC* spec) {
   int V = spec->org_entry.count[int(HMC::Level::Vault)];    // get the vault count.
   int S = configs.get_stacks();                             // get the stack count.
   int total_vault_number = V * S;                           // get the total no of vault in memory (currently one stack support).
@@ -226,15 +534,140 @@ void start_run<HMC>(const Config& configs, HMC* spec, const vector<string>& file
     Controller<HMC>* ctrl = new Controller<HMC>(configs, vault);
     vault_ctrls.push_back(ctrl);
   }
-  Memory<HMC, Controller> memory(configs, vault_ctrls);
+  return vault_ctrls;
+}
 
-  assert(files.size() != 0);
-  if (configs["trace_type"] == "CPU") {
-    run_cputrace(configs, memory, files);
-  } 
-  else {
+HMC* new_hmc_spec(const Config& configs) {
+  return new HMC(configs["org"], configs["speed"], configs["maxblock"],
+      configs["link_width"], configs["lane_speed"],
+      configs.get_int_value("source_mode_host_links"),
+      configs.get_int_value("payload_flits"));
+}
+
+/* the parameters of the analytical memory: from analytical_calibration, or fitted on a cycle-level memory built on
+   a thread of its own, so that its statistics do not join the simulation's */
+AnalyticalMemory::Calibration analytical_calibration(const Config& configs) {
+  AnalyticalMemory::Calibration calibration;
+  if (configs.get_analytical_calibration() != "") {
+    if (!calibration.parse(configs.get_analytical_calibration())) {
+      cout << "analytical_calibration takes seven values (hit, miss, bank, column, burst, link and flit cycles): " << configs.get_analytical_calibration() << endl;
+      exit(1);
+    }
+    return calibration;
+  }
+  thread([&]() {
+    HMC* spec = new_hmc_spec(configs);
+    Memory<HMC, Controller> reference(configs, hmc_vault_ctrls(configs, spec));
+    calibration = AnalyticalMemory::calibrate(configs, spec, reference);
+  }).join();
+  printf("Analytical memory calibrated: analytical_calibration = %s\n", calibration.str().c_str());
+  return calibration;
+}
+
+template<>
+void start_run<HMC>(const Config& configs, HMC* spec, const vector<string>& files, function<void()> built) {
+  if (configs["trace_type"] != "CPU") {
     cout << "Trace type should be CPU type." << endl ;
+    if (built) built();
+    return;
   }
+  assert(files.size() != 0);
+
+  if (configs.get_memory_model() == "Analytical") {
+    AnalyticalMemory memory(configs, spec, analytical_calibration(configs));
+    run_cputrace(configs, memory, files, built);
+    return;
+  }
+  Memory<HMC, Controller> memory(configs, hmc_vault_ctrls(configs, spec));
+  run_cputrace(configs, memory, files, built);
+}
+
+/* finish the configuration of one simulator and run it */
+void run_config(Config configs, const vector<string>& files, function<void()> built = nullptr)
+{
+    const std::string& standard = configs["standard"];
+
+    configs.set_core_num(configs.get_core_num());
+    configs.set_org(configs.get_core_org());
+
+    if (configs["unlimit_bandwidth"] == "true") {
+      configs.set("speed", configs["speed"] + "_unlimit_bandwidth");
+    }
+    
+    if (standard == "HMC") {
+      start_run(configs, new_hmc_spec(configs), files, built);
+    }
+    else {
+      cout << "Currently it supporting HMC, later it can be extended." << endl ;
+      if (built) built();
+    }
+}
+
+/* --sweep: every combination of the swept values runs in its own simulator (configuration, memory, processors and
+   statistics) on its own thread of this process. The traces are read and decoded once for all of them. */
+int run_sweep(const Config& base, const vector<string>& sweeps, const string& stats_out, const vector<string>& files)
+{
+    vector<pair<string, Config>> runs = {{"", base}};
+    for (auto& sweep : sweeps) {
+      size_t equal = sweep.find('=');
+      string key = sweep.substr(0, equal);
+      if (equal == string::npos || equal == 0 || equal + 1 == sweep.size()) {
+        cout << "--sweep takes key=value,value,... (got " << sweep << ")" << endl;
+        return 1;
+      }
+      if (key.compare(0, 6, "trace_") == 0) {
+        cout << "--sweep can not change " << key << ", the simulators share the decoded traces." << endl;
+        return 1;
+      }
+      vector<pair<string, Config>> grown;
+      for (auto& run : runs) {
+        size_t from = equal + 1;
+        while (from <= sweep.size()) {
+          size_t comma = min(sweep.find(',', from), sweep.size());
+          string value = sweep.substr(from, comma - from);
+          Config configs = run.second;
+          configs.set(key, value);
+          grown.push_back(make_pair(run.first + "." + key + "-" + value, configs));
+          from = comma + 1;
+        }
+      }
+      runs.swap(grown);
+    }
+    for (auto& run : runs) {
+      if (run.second.get_simulation_mode() == "Oracle") {
+        cout << "The Oracle mode forks the simulator, it can not run in a sweep." << endl;
+        return 1;
+      }
+    }
+
+    // the first blocks of the shared traces are kept until every simulator has opened them.
+    SharedTraceStream::enable();
+    mutex lock;
+    condition_variable all_built;
+    size_t built = 0;
+    auto arrive = [&]() {
+      unique_lock<mutex> guard(lock);
+      if (++built == runs.size()) {
+        SharedTraceStream::release_starts();
+        all_built.notify_all();
+      }
+      all_built.wait(guard, [&]() { return built == runs.size(); });
+    };
+
+    printf("Sweep: %d simulators\n", int(runs.size()));
+    vector<thread> threads;
+    for (auto& run : runs) {
+      threads.emplace_back([&]() {
+        Stats::statlist.output(stats_out + run.first);
+        run_config(run.second, files, arrive);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+
+    for (auto& run : runs)
+      cout << "Simulation done. Statistics written to " << stats_out + run.first << endl;
+    return 0;
 }
 
 int main(int argc, const char *argv[])
@@ -246,6 +679,10 @@ int main(int argc, const char *argv[])
       ("config", po::value<string>(), "path to config file.")
       ("stats", po::value<string>(), "path to output file.")
       ("trace", po::value<std::vector<string>>()->multitoken(), "a single or a list of file name(s) that are the traces to run.")
+      ("checkpoint-at", po::value<long>(), "save the simulator state once this many warmup instructions have executed.")
+      ("checkpoint-file", po::value<string>(), "path to the checkpoint image (default: the stats file with .ckpt).")
+      ("restore", po::value<string>(), "continue from a checkpoint image instead of a cold start.")
+      ("sweep", po::value<std::vector<string>>(), "key=value,value,... runs the configuration with each value (repeated: every combination) in one process, the stats file gets .key-value appended.")
        ;
     
     // read the configuration from config and setting up.
@@ -276,7 +713,27 @@ int main(int argc, const char *argv[])
     } else {
       stats_out = standard + string(".stats");
     }
-    Stats::statlist.output(stats_out);
+
+    if (vm.count("checkpoint-at")) {
+      long checkpoint_at = vm["checkpoint-at"].as<long>();
+      if (checkpoint_at <= 0 || checkpoint_at > configs.get_warmup_insts()) {
+        cout << "--checkpoint-at has to be within the warmup (1 to simulated_warmup_insts)." << endl;
+        return 1;
+      }
+      configs.add("checkpoint_at", to_string(checkpoint_at));
+      configs.add("checkpoint_file", vm.count("checkpoint-file") ? vm["checkpoint-file"].as<string>() : stats_out + ".ckpt");
+    }
+    if (vm.count("restore")) {
+      configs.add("restore_file", vm["restore"].as<string>());
+    }
+
+    // the Oracle mode forks the simulator at the regions, only the simulation thread may be running then.
+    if (configs.get_simulation_mode() == "Oracle") {
+      configs.set("trace_decode_workers", "0");
+      configs.set("vault_tick_threads", "0");
+      configs.set("sim_quantum_ns", "0");
+      configs.add("oracle_log", stats_out + ".oracle");
+    }
     
     std::vector<string> files;
     if (vm.count("trace")) {
@@ -285,24 +742,17 @@ int main(int argc, const char *argv[])
       cout << "trace file name(s) is(are) required. (missing --trace [core1-trace core2-trace...])";
     }
 
-    configs.set_core_num(configs.get_core_num());
-    configs.set_org(configs.get_core_org());
-
-    if (configs["unlimit_bandwidth"] == "true") {
-      configs.set("speed", configs["speed"] + "_unlimit_bandwidth");
-    }
-    
-    if (standard == "HMC") {
-      HMC* hmc = new HMC(configs["org"], configs["speed"], configs["maxblock"],
-          configs["link_width"], configs["lane_speed"],
-          configs.get_int_value("source_mode_host_links"),
-          configs.get_int_value("payload_flits"));
-      start_run(configs, hmc, files);
-    }
-    else {
-      cout << "Currently it supporting HMC, later it can be extended." << endl ;
+    if (vm.count("sweep")) {
+      if (vm.count("checkpoint-at") || vm.count("restore")) {
+        cout << "--sweep can not be combined with checkpoints." << endl;
+        return 1;
+      }
+      return run_sweep(configs, vm["sweep"].as<vector<string>>(), stats_out, files);
     }
 
+    Stats::statlist.output(stats_out);
+    run_config(configs, files);
+
     cout << "Simulation done. Statistics written to " << stats_out << endl ;
 
     return 0;
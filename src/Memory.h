@@ -38,8 +38,10 @@ public:
     virtual long page_allocator(long addr, int coreid) = 0;
     virtual void record_core(int coreid) = 0;
     virtual long get_memory_transection_info() = 0;
+    virtual double get_transaction_bytes() = 0;    // bytes read and written by the vaults so far.
     virtual int pending_link_packets() = 0;
     virtual void restore_hmc_tags() = 0;
+    virtual int get_vault_target(long addr) { return 0; }    // vault holding the address, 0 without vaults.
 };
 
 template <class T, template<typename> class Controller = Controller >
@@ -576,6 +578,10 @@ public:
     long get_memory_transection_info() {
         return ((read_transaction_bytes.value() * 1e9) + (write_transaction_bytes.value() * 1e9));
     }
+
+    double get_transaction_bytes() {
+        return read_transaction_bytes.value() + write_transaction_bytes.value();
+    }
     
     long page_allocator(long addr, int coreid) {
         long virtual_page_number = addr >> 12;
@@ -0,0 +1,101 @@
+#include "PageAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+using namespace ramulator;
+
+const int PageAllocator::PAGE_BITS;
+
+PageAllocator::PageAllocator(ScalarStat& memory_footprint, ScalarStat& physical_page_replacement)
+    : memory_footprint(memory_footprint), physical_page_replacement(physical_page_replacement)
+{
+    seed_rand();
+}
+
+void PageAllocator::init(const Config& configs, long capacity)
+{
+    if (configs["translation"] == "Random") {
+        translation = Translation::Random;
+        free_physical_pages_remaining = capacity >> PAGE_BITS;
+        free_physical_pages.assign(free_physical_pages_remaining, -1);
+    }
+}
+
+/* a page already drawn keeps its physical page. A new one takes a random free page, or the next free one after it */
+long PageAllocator::translate(long addr, int coreid)
+{
+    if (translation == Translation::None)
+        return addr;
+
+    auto target = make_pair(coreid, addr >> PAGE_BITS);
+    auto found = page_translation.find(target);
+    if (found == page_translation.end()) {
+        memory_footprint += 1 << PAGE_BITS;
+        long page = lrand() % free_physical_pages.size();
+        if (!free_physical_pages_remaining) {
+            physical_page_replacement++;
+            assert(free_physical_pages[page] != -1);
+        } else {
+            long start = page;
+            while (free_physical_pages[page] != -1) {
+                page = (page + 1) % free_physical_pages.size();
+                if (page == start)
+                    break;
+            }
+            assert(free_physical_pages[page] == -1);
+            free_physical_pages[page] = coreid;
+            --free_physical_pages_remaining;
+        }
+        found = page_translation.insert(make_pair(target, page)).first;
+    }
+    return (found->second << PAGE_BITS) | (addr & ((1 << PAGE_BITS) - 1));
+}
+
+/* the free list is mostly -1, only the used pages are saved. The rand() sequence is replayed up to where it was */
+void PageAllocator::checkpoint(Checkpoint& cp)
+{
+    cp.io(free_physical_pages_remaining);
+    cp.io(page_translation);
+    vector<pair<long, int>> used_pages;
+    for (unsigned long i = 0; i < free_physical_pages.size(); i++)
+        if (free_physical_pages[i] != -1)
+            used_pages.push_back(make_pair(i, free_physical_pages[i]));
+    cp.io(used_pages);
+    cp.io(rand_calls);
+    if (cp.restoring) {
+        fill(free_physical_pages.begin(), free_physical_pages.end(), -1);
+        for (auto& page : used_pages)
+            free_physical_pages[page.first] = page.second;
+        seed_rand();
+        for (long i = 0; i < rand_calls; i++)
+            next_rand();
+    }
+}
+
+/* same sequence as rand() with its default seed, but not shared with the other simulators of the process */
+void PageAllocator::seed_rand()
+{
+    rand_state = random_data();
+    initstate_r(1, rand_buf, sizeof(rand_buf), &rand_state);
+}
+
+int PageAllocator::next_rand()
+{
+    int32_t value;
+    random_r(&rand_state, &value);
+    return value;
+}
+
+long PageAllocator::lrand()
+{
+    if (sizeof(int) < sizeof(long)) {
+        rand_calls += 2;
+        long high = next_rand();
+        return high << (sizeof(int) * 8) | next_rand();
+    }
+
+    rand_calls++;
+    return next_rand();
+}
@@ -0,0 +1,53 @@
+#ifndef __PAGE_ALLOCATOR_H
+#define __PAGE_ALLOCATOR_H
+
+#include "Checkpoint.h"
+#include "Config.h"
+#include "Statistics.h"
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace ramulator
+{
+
+/*
+ * page translation of the memory models (translation = None or Random). With Random, every new 4KB page of a core
+ * gets a free physical page drawn at random, or replaces a used one once none is free. The draws come from the
+ * allocator's own rand() sequence, so the simulators of a sweep allocate the same pages as separate runs.
+ */
+class PageAllocator
+{
+public:
+    // the new and the replaced pages are counted on these stats of the memory
+    PageAllocator(ScalarStat& memory_footprint, ScalarStat& physical_page_replacement);
+
+    // translation of configs over a memory of capacity bytes
+    void init(const Config& configs, long capacity);
+    long translate(long addr, int coreid);
+    // the page map, the used physical pages and the position in the rand() sequence
+    void checkpoint(Checkpoint& cp);
+
+private:
+    static const int PAGE_BITS = 12;
+
+    enum class Translation { None, Random } translation = Translation::None;
+    std::vector<int> free_physical_pages;               // owning core of each physical page, -1 when free
+    long free_physical_pages_remaining = 0;
+    std::map<std::pair<int, long>, long> page_translation;
+    long rand_calls = 0;    // rand() draws so far, replayed when a checkpoint is restored
+    random_data rand_state;
+    char rand_buf[128];
+
+    ScalarStat& memory_footprint;
+    ScalarStat& physical_page_replacement;
+
+    void seed_rand();
+    int next_rand();
+    long lrand();
+};
+
+} /* namespace ramulator */
+
+#endif /* __PAGE_ALLOCATOR_H */
@@ -0,0 +1,185 @@
+#include "Prefetcher.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace ramulator
+{
+
+const long Prefetcher::PAGE_SIZE;
+const int IpStridePrefetcher::ENTRIES;
+const int StreamPrefetcher::STREAMS;
+const long StreamPrefetcher::DISTANCE;
+
+/* the prefetcher of a cache level by its configured name */
+Prefetcher* Prefetcher::create(const string& name, const string& level, int block_size, int degree)
+{
+    if (name == "none")
+        return nullptr;
+    if (name == "next_line")
+        return new NextLinePrefetcher(level, block_size, degree);
+    if (name == "ip_stride")
+        return new IpStridePrefetcher(level, block_size, degree);
+    if (name == "stream")
+        return new StreamPrefetcher(level, block_size, degree);
+    printf("Unknown prefetcher \"%s\" for the %s caches (none, next_line, ip_stride or stream).\n",
+           name.c_str(), level.c_str());
+    exit(1);
+}
+
+Prefetcher::Prefetcher(const string& name, const string& level, int block_size, int degree)
+    : name(name), block_size(block_size), degree(degree)
+{
+    candidates.reserve(degree);
+    issued.name(level + "_" + name + "_prefetch_issued")
+        .desc("prefetches sent to the lower level")
+        .precision(0);
+    useful.name(level + "_" + name + "_prefetch_useful")
+        .desc("prefetched lines hit by a demand access")
+        .precision(0);
+    late.name(level + "_" + name + "_prefetch_late")
+        .desc("demand misses merged into a prefetch in flight")
+        .precision(0);
+    throttled.name(level + "_" + name + "_prefetch_throttled")
+        .desc("prefetches dropped to keep MSHR entries for the demand misses")
+        .precision(0);
+}
+
+void Prefetcher::access(long addr, long pc, bool miss, bool prefetch_hit)
+{
+    candidates.clear();
+    on_access(addr, pc, miss, prefetch_hit);
+}
+
+bool Prefetcher::add(long addr, long lines)
+{
+    long target = (addr & ~(block_size - 1l)) + lines * block_size;
+    if (target < 0 || target / PAGE_SIZE != addr / PAGE_SIZE)
+        return false;
+    candidates.push_back(target);
+    return true;
+}
+
+void NextLinePrefetcher::on_access(long addr, long pc, bool miss, bool prefetch_hit)
+{
+    if (!miss && !prefetch_hit)
+        return;
+    for (int i = 1; i <= degree; i++)
+        if (!add(addr, i))
+            break;
+}
+
+IpStridePrefetcher::IpStridePrefetcher(const string& level, int block_size, int degree)
+    : Prefetcher("ip_stride", level, block_size, degree), table(ENTRIES)
+{
+}
+
+/* a stride that differs lowers the confidence, it replaces the stride of the entry once the confidence is gone */
+void IpStridePrefetcher::on_access(long addr, long pc, bool miss, bool prefetch_hit)
+{
+    if (pc == 0)
+        return;
+    Entry& entry = table[(pc ^ (pc >> 8) ^ (pc >> 16)) & (ENTRIES - 1)];
+    long line = addr / block_size;
+    if (entry.pc != pc)
+    {
+        entry = Entry();
+        entry.pc = pc;
+        entry.last = line;
+        return;
+    }
+    long stride = line - entry.last;
+    if (stride == 0)
+        return;
+    entry.last = line;
+    if (stride == entry.stride)
+        entry.confidence = min(3, entry.confidence + 1);
+    else
+    {
+        entry.confidence = max(0, entry.confidence - 1);
+        if (entry.confidence == 0)
+            entry.stride = stride;
+    }
+    if (entry.confidence < 2)
+        return;
+    for (int i = 1; i <= degree; i++)
+        if (!add(addr, entry.stride * i))
+            break;
+}
+
+void IpStridePrefetcher::checkpoint(Checkpoint& cp)
+{
+    cp.io(table);
+}
+
+StreamPrefetcher::StreamPrefetcher(const string& level, int block_size, int degree)
+    : Prefetcher("stream", level, block_size, degree), streams(STREAMS)
+{
+}
+
+/* a new page takes the least recently used stream, a change of direction starts the stream over from that line */
+void StreamPrefetcher::on_access(long addr, long pc, bool miss, bool prefetch_hit)
+{
+    if (!miss && !prefetch_hit)
+        return;
+    long page = addr / PAGE_SIZE;
+    long line = addr / block_size;
+    accesses++;
+
+    Stream* stream = &streams[0];
+    for (auto& candidate : streams)
+    {
+        if (candidate.page == page)
+        {
+            stream = &candidate;
+            break;
+        }
+        if (candidate.used < stream->used)
+            stream = &candidate;
+    }
+    if (stream->page != page)
+    {
+        *stream = Stream();
+        stream->page = page;
+        stream->last = line;
+        stream->ahead = line;
+        stream->used = accesses;
+        return;
+    }
+    stream->used = accesses;
+
+    int direction = (line > stream->last) ? 1 : (line < stream->last) ? -1 : 0;
+    if (direction == 0)
+        return;
+    if (direction == stream->direction)
+        stream->confidence = min(3, stream->confidence + 1);
+    else
+    {
+        stream->direction = direction;
+        stream->confidence = 1;
+        stream->ahead = line;
+    }
+    stream->last = line;
+    if (stream->confidence < 2)
+        return;
+
+    long from = (direction > 0) ? max(stream->ahead, line) : min(stream->ahead, line);
+    for (int i = 1; i <= degree; i++)
+    {
+        long next = from + direction * i;
+        if ((next - line) * direction > DISTANCE || !add(addr, next - line))
+            break;
+        stream->ahead = next;
+    }
+}
+
+void StreamPrefetcher::checkpoint(Checkpoint& cp)
+{
+    cp.io(streams);
+    cp.io(accesses);
+}
+
+} /* namespace ramulator */
@@ -0,0 +1,110 @@
+#ifndef __PREFETCHER_H
+#define __PREFETCHER_H
+
+#include "Checkpoint.h"
+#include "Statistics.h"
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+/*
+ * hardware prefetcher of one cache (l1_prefetcher, l2_prefetcher, llc_prefetcher and mcp_l1_prefetcher: none,
+ * next_line, ip_stride or stream). The cache shows it the demand accesses it takes and sends the lines it proposes
+ * below like misses, as long as enough MSHR entries stay free for the demand misses. Physical pages are allocated at
+ * random, so a prefetch never leaves the page of the access that triggered it.
+ */
+class Prefetcher
+{
+public:
+    // nullptr for none
+    static Prefetcher* create(const std::string& name, const std::string& level, int block_size, int degree);
+    virtual ~Prefetcher() {}
+
+    const std::string name;
+
+    // a demand access: the instruction that made it (0 when unknown), whether it missed and whether it hit a line
+    // this cache prefetched. The lines to prefetch are left in candidates, the nearest first.
+    void access(long addr, long pc, bool miss, bool prefetch_hit);
+    std::vector<long> candidates;
+
+    virtual void checkpoint(Checkpoint& cp) {}
+
+    ScalarStat issued;      // prefetches sent below
+    ScalarStat useful;      // prefetched lines hit by a demand access
+    ScalarStat late;        // demand misses merged into a prefetch still in flight
+    ScalarStat throttled;   // candidates dropped to keep the MSHR entries for the demand misses
+
+protected:
+    Prefetcher(const std::string& name, const std::string& level, int block_size, int degree);
+
+    static const long PAGE_SIZE = 4096;
+    int block_size;
+    int degree;                 // lines proposed per trigger (prefetch_degree)
+
+    // the line so many lines away from the one of addr, false when it is in another page
+    bool add(long addr, long lines);
+
+    virtual void on_access(long addr, long pc, bool miss, bool prefetch_hit) = 0;
+};
+
+// the next lines after a miss or after a hit on a prefetched line (tagged next-line).
+class NextLinePrefetcher : public Prefetcher
+{
+public:
+    NextLinePrefetcher(const std::string& level, int block_size, int degree)
+        : Prefetcher("next_line", level, block_size, degree) {}
+
+protected:
+    void on_access(long addr, long pc, bool miss, bool prefetch_hit);
+};
+
+// the stride of each instruction, once it repeated: a direct-mapped table by instruction pointer.
+class IpStridePrefetcher : public Prefetcher
+{
+public:
+    IpStridePrefetcher(const std::string& level, int block_size, int degree);
+    void checkpoint(Checkpoint& cp);
+
+protected:
+    struct Entry {
+        long pc = 0;
+        long last = 0;          // line of its last access
+        long stride = 0;        // in lines
+        int confidence = 0;     // 0 to 3, prefetching from 2 on
+    };
+    static const int ENTRIES = 256;
+    std::vector<Entry> table;
+
+    void on_access(long addr, long pc, bool miss, bool prefetch_hit);
+};
+
+// ascending or descending streams of misses within a page: once two steps went the same way, the stream is
+// prefetched up to DISTANCE lines ahead of its last access, degree lines at a time.
+class StreamPrefetcher : public Prefetcher
+{
+public:
+    StreamPrefetcher(const std::string& level, int block_size, int degree);
+    void checkpoint(Checkpoint& cp);
+
+protected:
+    struct Stream {
+        long page = -1;
+        long last = 0;          // line of its last access
+        long ahead = 0;         // furthest line prefetched
+        int direction = 0;      // +1, -1, 0 before the second access
+        int confidence = 0;     // 0 to 3, prefetching from 2 on
+        long used = 0;          // the least recently used stream is replaced
+    };
+    static const int STREAMS = 16;
+    static const long DISTANCE = 16;
+    std::vector<Stream> streams;
+    long accesses = 0;
+
+    void on_access(long addr, long pc, bool miss, bool prefetch_hit);
+};
+
+} /* namespace ramulator */
+
+#endif /* __PREFETCHER_H */
@@ -1,5 +1,11 @@
 #include "Processor.h"
 #include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <cassert>
 
@@ -53,6 +59,9 @@ Processor::Processor(const Config &configs,
         }
     }
 
+    for (auto &core : cores)
+        core->inst_queue.pool = &pool;
+
     /* if CPU side the load the trace, otherwise only assign the perent processor interface */
     if (!is_nmp)
     {
@@ -63,6 +72,7 @@ Processor::Processor(const Config &configs,
             cores[i]->own_proc = this;
             cores[i]->expected_limit_insts = configs.get_expected_limit_insts();
         }
+        check_trace_summaries();
     }
     else
     {
@@ -105,6 +115,15 @@ Processor::Processor(const Config &configs,
         total_energy_consumption.name("total_energy_consumption")
             .desc("Total energy consumption")
             .precision(0);
+        init_sampling_stats("");
+        sampler.first = configs.get_sample_first_instances();
+        sampler.period = configs.get_sample_period();
+        init_oracle_stats("");
+        if (configs.get_simulation_mode() == "Oracle")
+        {
+            oracle_log.open(configs.get_oracle_log());
+            oracle_log << "region,core,cycle,host_cycles,host_insts,offload_cycles,offload_insts,choice,speedup" << endl;
+        }
     }
     else
     {
@@ -129,6 +148,8 @@ Processor::Processor(const Config &configs,
         total_energy_consumption.name("nmp_side_energy_consumption")
             .desc("NMP side total energy consumption")
             .precision(0);
+        init_sampling_stats("nmp_");
+        init_oracle_stats("nmp_");
     }
 
     /* set all metrics to zero initially */
@@ -175,7 +196,10 @@ Processor::Processor(const Config &configs,
 
     /* assign the perent processor interface */
     for (int i = 0; i < number_cores; ++i)
+    {
         cores[i]->own_proc = this;
+        cores[i]->inst_queue.pool = &pool;
+    }
 
     /* bind cores to memory by making receive function as callback */
     ipcs.resize(number_cores);
@@ -207,6 +231,8 @@ Processor::Processor(const Config &configs,
     total_energy_consumption.name("nlp_side_energy_consumption")
         .desc("NLP side total energy consumption")
         .precision(0);
+    init_sampling_stats("nlp_");
+    init_oracle_stats("nlp_");
 
     /* set all metrics to zero initially */
     general_ipc = 0.0;
@@ -218,6 +244,45 @@ Processor::Processor(const Config &configs,
     total_energy_consumption = 0;
 }
 
+/* validate the traces against the host cores and the instruction limit using their summaries */
+void Processor::check_trace_summaries()
+{
+    bool all_summarized = true;
+    uint64_t trace_instructions = 0;
+    for (int i = 0; i < number_cores; ++i)
+    {
+        if (!cores[i]->trace_assigned) continue;
+        const Trace &trace = cores[i]->trace_per_core;
+        if (!trace.has_summary) { all_summarized = false; continue; }
+
+        // a merged trace hands thread t to host core t.
+        if (!cores[i]->per_thread_trace && int(trace.summary.thread_count) > number_cores)
+        {
+            std::cerr << "The trace has " << trace.summary.thread_count << " threads but only " << number_cores
+                      << " host cores are configured (core_num)." << std::endl;
+            exit(1);
+        }
+        trace_instructions += trace.summary.instruction_count;
+    }
+    if (!all_summarized || trace_instructions == 0) return;
+
+    int participating = 0;
+    for (int i = 0; i < number_cores; ++i)
+        if (cores[i]->trace_assigned && cores[i]->per_thread_trace) participating++;
+        else if (cores[i]->trace_assigned) participating += cores[i]->trace_per_core.summary.thread_count;
+    participating_cores = min(participating, number_cores);
+    cout << "Trace: " << trace_instructions << " instructions on " << participating_cores << " of " << number_cores << " host cores" << endl;
+
+    // the limit can not be reached past the end of the trace.
+    long limit = configs.get_expected_limit_insts();
+    if (limit > long(trace_instructions))
+    {
+        cout << "expected_limit_insts (" << limit << ") exceeds the trace, limited to " << trace_instructions << " instructions" << endl;
+        for (int i = 0; i < number_cores; ++i)
+            cores[i]->expected_limit_insts = trace_instructions;
+    }
+}
+
 /* processor tick as clock pulse */
 void Processor::tick()
 {
@@ -228,8 +293,8 @@ void Processor::tick()
         if ((int(cpu_cycles.value()) % 1000000) == 0) {
             printf("CPU heartbeat, cycles: %d \n", (int(cpu_cycles.value())));
             printf("CPU executed instructions: %d\n", int(calculate_total_instruction()));
-            printf("NMP executed instructions: %d\n", int(nmp_proc->calculate_total_instruction()));
-            printf("NLP executed instructions: %d\n", int(nlp_proc->calculate_total_instruction()));
+            printf("NMP executed instructions: %d\n", int(nmp_proc->seen_total_instruction(this)));
+            printf("NLP executed instructions: %d\n", int(nlp_proc->seen_total_instruction(this)));
         }
     }
 
@@ -238,11 +303,16 @@ void Processor::tick()
         cachesys->tick();
     }
 
+    // idle cores sleep until another side hands them work, their idle ticks are accounted when they wake.
     for (unsigned int i = 0; i < cores.size(); i++)
     {
+        ticking_core = i;
         Core *core = cores[i].get();
+        if (core->sleeping) continue;
+        if (core->can_sleep()) { core->sleep(); continue; }
         core->tick();
     }
+    ticking_core = cores.size();
 }
 
 /* when the processor recv a call back from memory */
@@ -280,6 +350,7 @@ void Processor::receive(Request &req)
 void Processor::calc_stats()
 {
     long long num_region_cnt = 0, offload_region_cnt = 0;
+    wake_all_cores();
 
     for (unsigned int i = 0; i < cores.size(); ++i)
     {
@@ -308,7 +379,8 @@ void Processor::calc_stats()
     }
 
     ipc = total_instructions / cpu_cycles.value();
-    average_idle_cycles = total_idle_cycles.value() / cores.size();
+    // the cores the trace leaves without a thread never run, they do not count in the average.
+    average_idle_cycles = total_idle_cycles.value() / (participating_cores > 0 ? participating_cores : cores.size());
     total_energy_consumption = calculate_Energy();
 
     cout << endl;
@@ -325,6 +397,218 @@ void Processor::calc_stats()
     total_time = total_instructions * (1 / ipc) * cycle_time;
     cout << "-> total time: " << total_time.value() << "ns" << endl;
     cout << endl;
+
+    if (sampler.enabled())
+        calc_sampling_stats();
+
+    if (oracle_best_cycles.value() > 0)
+    {
+        cout << "-> oracle: " << oracle_offloaded_regions.value() << " of "
+             << oracle_host_regions.value() + oracle_offloaded_regions.value() << " region instances offloaded, speedup "
+             << oracle_host_cycles.value() / oracle_best_cycles.value() << "x over the host, "
+             << oracle_offload_cycles.value() / oracle_best_cycles.value() << "x over offloading" << endl;
+        cout << endl;
+    }
+}
+
+/* statistics of the sampled simulation, they are only printed once ROI instances have been skipped */
+void Processor::init_sampling_stats(const string &prefix)
+{
+    sampled_region_instances.name(prefix + "sampled_region_instances")
+        .desc("ROI instances simulated in detail (sampled simulation)")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    skipped_region_instances.name(prefix + "skipped_region_instances")
+        .desc("ROI instances fast-forwarded (sampled simulation)")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    skipped_region_instructions.name(prefix + "skipped_region_instructions")
+        .desc("instructions of the fast-forwarded ROI instances")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_cycles.name(prefix + "extrapolated_cycles")
+        .desc("cpu cycles with the estimate for the skipped ROI instances")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_cycles_ci95.name(prefix + "extrapolated_cycles_ci95")
+        .desc("half width of the 95% confidence interval of extrapolated_cycles")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_time.name(prefix + "extrapolated_time")
+        .desc("Total Time (ns) with the estimate for the skipped ROI instances")
+        .precision(6)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_memory_bytes.name(prefix + "extrapolated_memory_bytes")
+        .desc("bytes read and written by the memory with the estimate for the skipped ROI instances")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_memory_bytes_ci95.name(prefix + "extrapolated_memory_bytes_ci95")
+        .desc("half width of the 95% confidence interval of extrapolated_memory_bytes")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_energy.name(prefix + "extrapolated_energy")
+        .desc("Total energy consumption with the estimate for the skipped ROI instances")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    extrapolated_energy_ci95.name(prefix + "extrapolated_energy_ci95")
+        .desc("half width of the 95% confidence interval of extrapolated_energy")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+}
+
+/* add the estimate of the skipped ROI instances to the measured cycles, memory traffic and energy. The energy of an
+   estimated cycle is the active energy of a core, the one of a byte the memory energy (cache accesses are left out). */
+void Processor::calc_sampling_stats()
+{
+    long sampled = 0, skipped = 0;
+    for (auto &entry : sampler.regions)
+    {
+        sampled += entry.second.instances - entry.second.skipped;
+        skipped += entry.second.skipped;
+    }
+    if (skipped == 0)
+        return;
+
+    std::pair<double, double> cycles = sampler.estimate(RegionSampler::CYCLES);
+    std::pair<double, double> bytes = sampler.estimate(RegionSampler::BYTES);
+    std::pair<double, double> energy = sampler.estimate(RegionSampler::ENERGY);
+    sampled_region_instances = sampled;
+    skipped_region_instances = skipped;
+    skipped_region_instructions = sampler.skipped_insts;
+    extrapolated_cycles = cpu_cycles.value() + cycles.first;
+    extrapolated_cycles_ci95 = cycles.second;
+    extrapolated_time = extrapolated_cycles.value() * cycle_time;
+    extrapolated_memory_bytes = memory.get_transaction_bytes() + bytes.first;
+    extrapolated_memory_bytes_ci95 = bytes.second;
+    extrapolated_energy = total_energy_consumption.value() + energy.first;
+    extrapolated_energy_ci95 = energy.second;
+
+    cout << "-> sampled/skipped region instances: " << sampled << "/" << skipped << endl;
+    cout << "-> extrapolated time: " << extrapolated_time.value() << "ns (+- "
+         << extrapolated_cycles_ci95.value() * cycle_time << "ns)" << endl;
+    cout << endl;
+}
+
+/* statistics of the Oracle mode, only printed when it evaluated ROI instances */
+void Processor::init_oracle_stats(const string &prefix)
+{
+    oracle_host_regions.name(prefix + "oracle_host_regions")
+        .desc("ROI instances the oracle kept on the host")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    oracle_offloaded_regions.name(prefix + "oracle_offloaded_regions")
+        .desc("ROI instances the oracle offloaded")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    oracle_host_cycles.name(prefix + "oracle_host_cycles")
+        .desc("cpu cycles of the evaluated ROI instances run on the host")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    oracle_offload_cycles.name(prefix + "oracle_offload_cycles")
+        .desc("cpu cycles of the evaluated ROI instances offloaded")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+    oracle_best_cycles.name(prefix + "oracle_best_cycles")
+        .desc("cpu cycles of the evaluated ROI instances with the faster choice")
+        .precision(0)
+        .flags(Stats::display | Stats::nozero);
+}
+
+/* Oracle mode: at an outer ROI_BEGIN the simulator forks a branch running the instance on the host and one
+   offloading it. Both run on in parallel until the instance is done, the parent takes the faster choice (and
+   simulates it once more). Regions beginning inside a branch or inside an offloaded region take the last choice. */
+bool Processor::oracle_decide(Core* core, long region)
+{
+    if (oracle_fd >= 0 || !core->offload_region_ids.empty())
+    {
+        auto choice = oracle_choices.find(region);
+        return choice == oracle_choices.end() || choice->second;
+    }
+
+    // only the simulation thread survives the fork: no chunk may be inflating, no buffered output may be doubled.
+    Processor* sides[] = {this, nmp_proc, nlp_proc};
+    for (auto side : sides)
+    {
+        side->trace.settle();
+        for (auto &each : side->cores)
+            each->trace_per_core.settle();
+    }
+    cout.flush();
+    fflush(stdout);
+    oracle_log.flush();
+
+    long cycles[2], insts[2];
+    pid_t branches[2];
+    int pipes[2][2];
+    for (int offload = 0; offload < 2; offload++)
+    {
+        if (pipe(pipes[offload]) != 0 || (branches[offload] = fork()) < 0)
+        {
+            printf("Oracle: can not fork the branches of region %ld.\n", region);
+            exit(1);
+        }
+        if (branches[offload] == 0)
+        {
+            for (int other = 0; other < offload; other++)
+                close(pipes[other][0]);
+            close(pipes[offload][0]);
+            oracle_fd = pipes[offload][1];
+            oracle_core = core;
+            oracle_region = region;
+            oracle_clk = core->clk;
+            oracle_insts = core->system_insts();
+            return offload;
+        }
+        close(pipes[offload][1]);
+    }
+
+    for (int offload = 0; offload < 2; offload++)
+    {
+        int status;
+        long report[2] = {0, 0};
+        bool reported = (read(pipes[offload][0], report, sizeof(report)) == sizeof(report));
+        cycles[offload] = max(1L, report[0]);
+        insts[offload] = report[1];
+        close(pipes[offload][0]);
+        waitpid(branches[offload], &status, 0);
+        if (!reported)
+        {
+            printf("Oracle: the %s branch of region %ld failed.\n", offload ? "offloading" : "host", region);
+            exit(1);
+        }
+    }
+
+    // the other cores run on (or wait for the offloaded region) meanwhile: the branch getting more work done per cycle
+    // wins, not the one finishing its own instance first.
+    double rate[2] = {double(insts[0]) / cycles[0], double(insts[1]) / cycles[1]};
+    bool offload = rate[1] > rate[0];
+    oracle_choices[region] = offload;
+    if (offload) oracle_offloaded_regions++;
+    else oracle_host_regions++;
+    oracle_host_cycles += cycles[0];
+    oracle_offload_cycles += cycles[1];
+    oracle_best_cycles += cycles[offload];
+    oracle_log << region << "," << core->id << "," << core->clk << "," << cycles[0] << "," << insts[0] << ","
+               << cycles[1] << "," << insts[1] << "," << (offload ? "offload" : "host") << ","
+               << max(rate[0], rate[1]) / max(1e-9, min(rate[0], rate[1])) << endl;
+    return offload;
+}
+
+/* a branch is done once its core runs on after the ROI_END and has retired the instance's last instructions */
+void Processor::oracle_check(Core* core)
+{
+    if (oracle_retire_target >= 0 && core->retired >= oracle_retire_target)
+        oracle_report();
+}
+
+/* end the branch: hand the cycles of the instance and the instructions all sides executed meanwhile to the parent
+   (the run may have ended before the instance) */
+void Processor::oracle_report()
+{
+    long report[2] = {oracle_core->clk - oracle_clk, oracle_core->system_insts() - oracle_insts};
+    if (write(oracle_fd, report, sizeof(report)) != sizeof(report))
+        _exit(1);
+    _exit(0);
 }
 
 /* used to check the processor side finish the trace or not */
@@ -358,6 +642,66 @@ bool Processor::finished()
     }
 }
 
+/* account the skipped ticks of every sleeping core (before reading the cores' cycle counts) */
+void Processor::wake_all_cores()
+{
+    for (unsigned int i = 0; i < cores.size(); ++i)
+        cores[i]->wake();
+}
+
+/* run an action of the from side on this side: right away, or at the next quantum boundary while the sides run apart */
+void Processor::post(const Processor* from, function<void()> action)
+{
+    if (across(from))
+        inbox.push_back(action);
+    else
+        action();
+}
+
+/* apply the actions the other sides posted during the quantum (at the boundary, in the order they were posted) */
+void Processor::apply_inbox()
+{
+    for (auto &action : inbox)
+        action();
+    inbox.clear();
+}
+
+/* refresh the state the other sides see during the next quantum (at the boundary, after apply_inbox) */
+void Processor::publish()
+{
+    published_insts = calculate_total_instruction();
+    if (is_nmp)
+    {
+        published_context_switch = can_context_switch(0, false);
+        published_nmp_switch = can_nmp_switch();
+    }
+    for (auto &core : cores)
+        core->inst_queue.seen_length = core->inst_queue.numberInstructionsInQueue;
+}
+
+float Processor::seen_total_instruction(const Processor* from)
+{
+    return across(from) ? published_insts : calculate_total_instruction();
+}
+
+/* an MCP side with actions still in its inbox has work the published state does not show yet */
+bool Processor::seen_context_switch(const Processor* from, long processID)
+{
+    if (!across(from))
+        return can_context_switch(processID);
+    if (!inbox.empty() || !published_context_switch)
+        return false;
+    memory.restore_hmc_tags();
+    return true;
+}
+
+bool Processor::seen_nmp_switch(const Processor* from)
+{
+    if (!across(from))
+        return can_nmp_switch();
+    return inbox.empty() && published_nmp_switch;
+}
+
 /* used to lock/unlock (true/false in argument) the core for not processing further trace line */
 void Processor::lock_all_cores(bool flag)
 {
@@ -439,7 +783,7 @@ void Processor::warmedup_activate()
 }
 
 /* return true if the processor side can switch to other side otherwise false (only between CPU and MCP) */
-bool Processor::can_context_switch(long processID)
+bool Processor::can_context_switch(long processID, bool restore_tags)
 {   
     //check all the empty or not, such as, cores window, cache req lists, memory req lists.
     if (!is_nmp && !nlp_side)   // used for CPU side only.
@@ -498,7 +842,7 @@ bool Processor::can_context_switch(long processID)
             if (memory.pending_requests() > 0) return false;
         }
 
-        memory.restore_hmc_tags();  // to resolve the co-simulation problem.
+        if (restore_tags) memory.restore_hmc_tags();  // to resolve the co-simulation problem.
     }   
     return true;
 }
@@ -516,6 +860,115 @@ void Processor::flush_all_caches()
     llc.flush_all_dirty_lines();
 }
 
+/* true when nothing of this side is in flight (cores, caches and memory), a checkpoint is taken only then */
+bool Processor::drained()
+{
+    for (auto &core : cores)
+        if (!core->drained())
+            return false;
+    if (!llc.mshr_entries.empty() || !llc.retry_list.empty() || !cachesys->wait_list.empty() || !cachesys->hit_list.empty())
+        return false;
+    return memory.pending_requests() == 0 && memory.pending_link_packets() == 0;
+}
+
+/* count an instance of the region, true when it is simulated in detail */
+bool RegionSampler::detailed(long region)
+{
+    long instance = regions[region].instances++;
+    return instance < first || (instance - first) % period == 0;
+}
+
+void RegionSampler::skipped(long region, long insts)
+{
+    regions[region].skipped++;
+    regions[region].skipped_insts += insts;
+    skipped_insts += insts;
+}
+
+/* an instance without instructions tells nothing about the cost per instruction */
+void RegionSampler::measured(long region, long core_insts, long all_insts, long cycles, double bytes, double energy)
+{
+    if (core_insts <= 0 || all_insts <= 0)
+        return;
+    Region &samples = regions[region];
+    double value[MAX] = {double(cycles), bytes, energy};
+    samples.samples++;
+    samples.insts += all_insts;
+    for (int m = 0; m < MAX; m++)
+    {
+        samples.value[m] += value[m];
+        samples.ratio[m] += value[m] / all_insts;
+        samples.ratio_sq[m] += (value[m] / all_insts) * (value[m] / all_insts);
+    }
+}
+
+/* ratio estimate per region (measured value per instruction times the skipped instructions), the variance comes from
+   the spread of the per-instance values. A region without a usable sample takes the ratio over all regions. */
+std::pair<double, double> RegionSampler::estimate(Metric metric) const
+{
+    double all_insts = 0, all_value = 0;
+    for (auto &entry : regions)
+    {
+        all_insts += entry.second.insts;
+        all_value += entry.second.value[metric];
+    }
+
+    double total = 0, variance = 0;
+    for (auto &entry : regions)
+    {
+        const Region &region = entry.second;
+        if (region.skipped_insts == 0)
+            continue;
+        if (region.samples == 0)
+        {
+            total += (all_insts > 0) ? region.skipped_insts * all_value / all_insts : 0;
+            continue;
+        }
+        total += region.skipped_insts * region.value[metric] / region.insts;
+        if (region.samples > 1)
+        {
+            double n = region.samples;
+            double mean = region.ratio[metric] / n;
+            double spread = max(0.0, (region.ratio_sq[metric] - n * mean * mean) / (n - 1));
+            variance += double(region.skipped_insts) * region.skipped_insts * spread / n;
+        }
+    }
+    return std::make_pair(total, 1.96 * sqrt(variance));
+}
+
+/* run the host cores functionally, one line each in turn, for insts instructions or up to the instance-th ROI_BEGIN
+   of region (the marker is then the next line of its core). Returns the instructions fast-forwarded. */
+long Processor::fast_forward(long insts, long region, long instance)
+{
+    long total = 0;
+    bool advanced = true;
+    while (advanced && (region >= 0 || total < insts))
+    {
+        advanced = false;
+        for (auto &core : cores)
+        {
+            if (region >= 0 && core->more_reqs && core->trace_line->is_roi_begin &&
+                long(core->trace_line->regionID) == region && --instance == 0)
+                return total;
+            long before = core->fast_forwarded;
+            advanced |= core->fast_forward();
+            total += core->fast_forwarded - before;
+            if (region < 0 && total >= insts) break;
+        }
+    }
+    return total;
+}
+
+/* save or restore the (drained) side: the cache system, the LLC and the cores */
+void Processor::checkpoint(Checkpoint &cp)
+{
+    cp.expect(cores.size(), "cores");
+    cachesys->checkpoint(cp);
+    llc.checkpoint(cp);
+    for (auto &core : cores)
+        core->checkpoint(cp);
+}
+
 
 /* return true if the one MCP side (NMP/NLP) can switch to other NMP side otherwise false (only between MCPs) */
 bool Processor::can_nmp_switch()
@@ -606,6 +1059,7 @@ float Processor::calculate_Energy()
     long idle_cycle = 0;
     long l1_cache_access = 0, l2_cache_access = 0, llc_cache_access = 0, memory_access = 0;
     float energy;
+    wake_all_cores();
     for (unsigned int i = 0; i < cores.size(); ++i)
     {
         active_cycle += (cores[i]->clk - cores[i]->idle_cycles.value());
@@ -671,6 +1125,8 @@ Core::Core(const Config &configs, int coreid, function<bool(Request)> send_next,
     inFlightMemoryAccess = 0;
     more_reqs = false;
     deployed_app_id = 0;
+    if (is_nmp && configs.contains("mcp_core_queue_max_size"))
+        inst_queue.credit_limit = configs.get_nmp_core_queue_max_size();    // bounded queues of the MCP PUs.
 
     // initially reset warmup.
     if (configs.get_warmup_insts() != 0)
@@ -782,7 +1238,46 @@ Core::Core(const Config &configs, int coreid, function<bool(Request)> send_next,
 /* initialize cycle consumption values w.r.t. opcode (for x86), it can be extend for diverse architecture */
 void Core::initialize_arch_cycle_db()
 {
-    std::ifstream opCyfile("common/x86_opcode_cycles.csv");
+    OpcodeTable::instance().load_cycles("common/x86_opcode_cycles.csv");
+}
+
+const InstructionPool::Handle InstructionPool::NONE;
+const InstructionPool::Handle InstructionPool::BLOCK_SLOTS;
+
+/* a released slot, or the next one of the slab (a new block once the last is used up) */
+InstructionPool::Handle InstructionPool::allocate()
+{
+    if (!free_handles.empty())
+    {
+        Handle handle = free_handles.back();
+        free_handles.pop_back();
+        return handle;
+    }
+    if ((allocated & (BLOCK_SLOTS - 1)) == 0)
+        blocks.emplace_back(new trace_instruction[BLOCK_SLOTS]);
+    return allocated++;
+}
+
+OpcodeTable::OpcodeTable()
+{
+    ids["ROI_BEGIN"] = ROI_BEGIN;
+    ids["ROI_END"] = ROI_END;
+}
+
+OpcodeTable& OpcodeTable::instance()
+{
+    static OpcodeTable table;
+    return table;
+}
+
+/* load the cycle consumption of every opcode (all cores share one table) */
+void OpcodeTable::load_cycles(const string& path)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (cycles_loaded) return;
+    cycles_loaded = true;
+
+    std::ifstream opCyfile(path);
     if (!opCyfile) {
         std::cerr << "Error opening file!" << std::endl;
         return;
@@ -793,29 +1288,43 @@ void Core::initialize_arch_cycle_db()
         std::string opcode;
         int cycleCount;
         if (std::getline(ss, opcode, ',') && ss >> cycleCount) {
-            opcodeCycleCount[opcode] = cycleCount;
+            cycle_db[opcode] = cycleCount;
         }
     }
 }
 
+/* id and cycle consumption of an opcode, new opcodes get the next free id */
+OpcodeTable::Info OpcodeTable::intern(const char* opcode, size_t length)
+{
+    std::string name(opcode, length);
+    std::lock_guard<std::mutex> guard(lock);
+    auto id = ids.find(name);
+    if (id == ids.end())
+        id = ids.insert(std::make_pair(name, int(ids.size()))).first;
+    auto cycles = cycle_db.find(name);
+    Info info = {id->second, cycles != cycle_db.end() ? cycles->second : 0};
+    return info;
+}
+
 /* it load the trace files for the core */
 void Core::load_trace(string trace_base_name, const Config &configs)
 {
     // cout << "Core " << id << " trying to load trace " << trace_base_name + "." + std::to_string(id) << endl;  // for debug purpose.
     if (trace_per_core.init_trace(trace_base_name + "." + std::to_string(id), configs)) { trace_assigned = true; }
+    per_thread_trace = (configs.get_trace_input() == "per_thread");
     // appName = trace_base_name;    // no need.
 }
 
 /* after trace read, requesting addresses will allocte in memory */
 void Core::memory_allocates()
 {
-    trace_line.instPointer = memory.page_allocator(trace_line.instPointer, id);
+    trace_line->instPointer = memory.page_allocator(trace_line->instPointer, id);
     for (int i = 0; i < NUM_INSTR_SOURCES; i++)  //considering eual number of source and destination addresses.
     {
-        if (trace_line.sourceAddr[i] != 0)
-            trace_line.sourceAddr[i] = memory.page_allocator(trace_line.sourceAddr[i], id);
-        if (trace_line.destAddr[i] != 0)
-            trace_line.destAddr[i] = memory.page_allocator(trace_line.destAddr[i], id);
+        if (trace_line->sourceAddr[i] != 0)
+            trace_line->sourceAddr[i] = memory.page_allocator(trace_line->sourceAddr[i], id);
+        if (trace_line->destAddr[i] != 0)
+            trace_line->destAddr[i] = memory.page_allocator(trace_line->destAddr[i], id);
     } 
 }
 
@@ -829,43 +1338,50 @@ void Core::execution_flag_set()
 
     for (size_t i = 0; i < NUM_INSTR_SOURCES; ++i)    // TODO:  can be optimize just checking index location
     {
-        if (trace_line.sourceAddr[i] != 0) loads_exe_flag = false;
-        if (trace_line.destAddr[i] != 0) stores_exe_flag = false;
+        if (trace_line->sourceAddr[i] != 0) loads_exe_flag = false;
+        if (trace_line->destAddr[i] != 0) stores_exe_flag = false;
     }
 
-    // get the no of cycle required to perform the operation by the core without memory transfer (getting from x86_opcode_cycles.csv).
-    if (opcodeCycleCount.find(trace_line.opcode) != opcodeCycleCount.end())
-        bubble_cnt = opcodeCycleCount[trace_line.opcode];
-    else
-        bubble_cnt = 0;
+    // get the no of cycle required to perform the operation by the core without memory transfer (resolved from x86_opcode_cycles.csv at trace read).
+    bubble_cnt = trace_line->cycle_cost;
+    inst_pc = trace_line->instPointer;    // kept for the loads and stores, instPointer is cleared once fetched.
+}
+
+/* execute the front instruction of the queue from its slot, the slot of the previous one goes back to the pool */
+void Core::take_queued()
+{
+    if (held != InstructionPool::NONE)
+        inst_queue.pool->release(held);
+    held = inst_queue.pop_front();
+    trace_line = &inst_queue.pool->at(held);
 }
 
 /* load first trace line when core to be execute */
 void Core::get_first_instruction()
 {
+    wake();
     if (!more_reqs)
     {
         if (trace_assigned)  // load from trace file.
         {
-            more_reqs = trace_per_core.get_trace_line(trace_line);
+            more_reqs = trace_per_core.get_trace_line(*trace_line);
             if (more_reqs) 
             {
-                deployed_app_id = trace_line.processID;
-                current_thread_id = 0;
+                deployed_app_id = trace_line->processID;
+                current_thread_id = per_thread_trace ? id : 0;
                 memory_allocates();
                 execution_flag_set();
                 lock_core = (!more_reqs);
                 if (configs.get_simulation_mode() == "MCP-Only") lock_core = true;
             }
         }
-        else // load from inst_queue.trace_queue (MCP PUs always load from queue).
+        else // load from inst_queue (MCP PUs always load from queue).
         {
             if (!inst_queue.is_empty())
             {
                 more_reqs = true;
-                trace_line = inst_queue.trace_queue.front();
-                inst_queue.pop_front();
-                deployed_app_id = trace_line.processID;
+                take_queued();
+                deployed_app_id = trace_line->processID;
                 execution_flag_set();
             }
             else 
@@ -889,14 +1405,14 @@ bool Core::get_next_instruction()
 {
     if (trace_assigned)
     {
-        more_reqs = trace_per_core.get_trace_line(trace_line);
+        more_reqs = trace_per_core.get_trace_line(*trace_line);
         memory_allocates();
-        while (trace_line.threadID != current_thread_id)
+        // a merged trace hands the other threads' lines to their cores, a per-thread trace has none.
+        while (more_reqs && !per_thread_trace && trace_line->threadID != current_thread_id)
         {
-            own_proc->cores[trace_line.threadID]->inst_queue.trace_queue.push_back(trace_line);
-            own_proc->cores[trace_line.threadID]->inst_queue.numberInstructionsInQueue++;
-            if (!own_proc->cores[trace_line.threadID]->more_reqs) own_proc->cores[trace_line.threadID]->get_first_instruction();
-            more_reqs = trace_per_core.get_trace_line(trace_line);
+            own_proc->cores[trace_line->threadID]->inst_queue.push_back(*trace_line);
+            if (!own_proc->cores[trace_line->threadID]->more_reqs) own_proc->cores[trace_line->threadID]->get_first_instruction();
+            more_reqs = trace_per_core.get_trace_line(*trace_line);
             memory_allocates();
         }
     }
@@ -905,18 +1421,78 @@ bool Core::get_next_instruction()
         if (!inst_queue.is_empty())
         {
             more_reqs = true;
-            trace_line = inst_queue.trace_queue.front();
-            inst_queue.pop_front();
+            take_queued();
         }
         else { more_reqs = false; }
     }
 
     // process id assigned from the trace, core get lock if there no request (it helps to not process further).
-    if (deployed_app_id != trace_line.processID) deployed_app_id = trace_line.processID;
+    if (deployed_app_id != trace_line->processID) deployed_app_id = trace_line->processID;
     lock_core = (!more_reqs);
+
+    // sampled simulation (host side, after the warmup): the instances left out of the sample are fast-forwarded here,
+    // the detailed ones are measured from their ROI_BEGIN until the core executes again after their ROI_END.
+    if (own_proc->sampler.enabled() && !is_nmp && is_warmup_done && !skipping)
+    {
+        while (more_reqs && trace_line->is_roi_begin)
+        {
+            if (sample_closing) close_sample();
+            if (sample_region >= 0) break;    // nested in a measured instance, simulated with it.
+            if (own_proc->sampler.detailed(trace_line->regionID))
+            {
+                sample_region = trace_line->regionID;
+                sample_clk = clk;
+                sample_insts = 0;
+                sample_all_insts = system_insts();
+                sample_bytes = memory.get_transaction_bytes();
+                sample_energy = own_proc->calculate_Energy();
+                break;
+            }
+            skip_region();
+        }
+        if (more_reqs && trace_line->is_roi_end && long(trace_line->regionID) == sample_region)
+            sample_closing = true;
+        else if (more_reqs && !trace_line->is_roi_marker() && sample_region >= 0 && !sample_closing)
+            sample_insts++;
+    }
+
+    if (own_proc->oracle_core == this && more_reqs && trace_line->is_roi_end && long(trace_line->regionID) == own_proc->oracle_region)
+        own_proc->oracle_closing = true;
     return more_reqs;
 }
 
+/* fast-forward the ROI instance starting at the current line up to the line after its ROI_END. The host caches are
+   only warmed in Host-Only mode, otherwise the instance would have run on the MCP side. */
+void Core::skip_region()
+{
+    long region = trace_line->regionID;
+    long before = fast_forwarded;
+    bool warm = (configs.get_simulation_mode() == "Host-Only");
+    skipping = true;
+    while (more_reqs && !(trace_line->is_roi_end && long(trace_line->regionID) == region))
+        fast_forward(warm);
+    if (more_reqs)
+        fast_forward(warm);
+    skipping = false;
+    own_proc->sampler.skipped(region, fast_forwarded - before);
+}
+
+long Core::system_insts()
+{
+    return long(own_proc->calculate_total_instruction() + nmp_proc->seen_total_instruction(own_proc) +
+                nlp_proc->seen_total_instruction(own_proc));
+}
+
+/* hand the measured instance to the sampler */
+void Core::close_sample()
+{
+    own_proc->sampler.measured(sample_region, sample_insts, system_insts() - sample_all_insts,
+                               clk - sample_clk, memory.get_transaction_bytes() - sample_bytes,
+                               own_proc->calculate_Energy() - sample_energy);
+    sample_region = -1;
+    sample_closing = false;
+}
+
 /* Out of order core working (instruction execution simulation) */
 void Core::tick_outOrder()
 { 
@@ -926,12 +1502,17 @@ void Core::tick_outOrder()
 
     // increament the no of retiered instruction.
     retired += window.retire();
+    if (own_proc->oracle_core == this)
+        own_proc->oracle_check(this);
 
     // if there no trace line/req then consume idle cycle.
     if (!more_reqs) { idle_cycles++; return; }   
 
     // if instruction fatching not recv at core then simply return.
     if (inFlightMemoryAccess >= 1) return;    
+
+    // a checkpoint is pending, nothing new is issued until the accesses in flight have completed.
+    if (own_proc->draining) return;
     
     // consume cycle to simulate overhead time consumption and context switching waiting.
     if (decision_overhead_cycles >= 0 && lock_core)
@@ -945,15 +1526,16 @@ void Core::tick_outOrder()
 
         if (!proc_switching_flag)    // wait for the CPU side to complete its current (upto offloadable region) operation. 
         {
-            proc_switching_flag = own_proc->can_context_switch(trace_line.processID);
+            proc_switching_flag = own_proc->can_context_switch(trace_line->processID);
             if (!proc_switching_flag) return;
         }
 
         if (decision_overhead_cycles == 0)    // when CPU ready to switch then load the trace line (instruction) in MCP PUs.
         {   
-            for (unsigned int k = 0; k < nmp_proc->cores.size(); ++k) {
-                nmp_proc->cores[k]->get_first_instruction();
-            }
+            nmp_proc->post(own_proc, [this]() {
+                for (unsigned int k = 0; k < nmp_proc->cores.size(); ++k)
+                    nmp_proc->cores[k]->get_first_instruction();
+            });
             
             if (configs.get_nlp_facility() == "on")
             {
@@ -967,15 +1549,16 @@ void Core::tick_outOrder()
     // if the MCP PU's queue has limit then bypass function will call again. 
     if (pending_inst_bypass)
     {
-        instruction_bypass();
+        lock_own_cores(trace_line->processID, true);
+        offload_pending();
         if (pending_inst_bypass) { idle_cycles++; return; }
     }
 
     // when control exit from offloadble region then wait for MCP to complete their execution then CPU start to perform.
     if (wait_for_nmp_finish)
     {
-        if (!nmp_proc->can_context_switch(trace_line.processID)) { idle_cycles++; return; }
-        if (configs.get_nlp_facility() == "on") if (!nlp_proc->can_context_switch(trace_line.processID)) { idle_cycles++; return; }
+        if (!nmp_proc->seen_context_switch(own_proc, trace_line->processID)) { idle_cycles++; return; }
+        if (configs.get_nlp_facility() == "on") if (!nlp_proc->seen_context_switch(own_proc, trace_line->processID)) { idle_cycles++; return; }
         wait_for_nmp_finish = false;
         proc_switching_flag = false;
     }
@@ -983,14 +1566,21 @@ void Core::tick_outOrder()
     // execute the instruction.
     if (!lock_core)
     {
+        if (sample_closing) close_sample();    // the measured ROI instance ends with the first instruction after it.
+        if (own_proc->oracle_core == this && own_proc->oracle_closing && own_proc->oracle_retire_target < 0)
+        {
+            own_proc->oracle_retire_target = retired + window.load;    // the instance's instructions still in the window.
+            own_proc->oracle_check(this);
+        }
+
         int inserted = 0;
-        if (trace_line.instPointer != 0)    // get the instruction from memory.
+        if (trace_line->instPointer != 0)    // get the instruction from memory.
         {
-            Request req(trace_line.instPointer, Request::Type::READ, callback, id, is_nmp);
+            Request req(trace_line->instPointer, Request::Type::READ, callback, id, is_nmp);
             req.instruction_request = true;
             if (!send(req)) { idle_cycles++; return; }
             inFlightMemoryAccess++;     // inst is fetching therefor no further execution until it recv.
-            trace_line.instPointer = 0;
+            trace_line->instPointer = 0;
             cpu_inst++;
             if (!loads_exe_flag || !stores_exe_flag) memory_inst++;
             inserted++;
@@ -1008,13 +1598,14 @@ void Core::tick_outOrder()
 
         if (!loads_exe_flag)    // memory read requset send to memory. 
         {
-            while (trace_line.sourceAddr[l_index] != 0)
+            while (trace_line->sourceAddr[l_index] != 0)
             {
                 if (inserted == window.ipc) { idle_cycles++; return; }
                 if (window.is_full()) { idle_cycles++; return; }
-                Request req(trace_line.sourceAddr[l_index], Request::Type::READ, callback, id, is_nmp);
+                Request req(trace_line->sourceAddr[l_index], Request::Type::READ, callback, id, is_nmp);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
-                window.insert(false, trace_line.sourceAddr[l_index]);
+                window.insert(false, trace_line->sourceAddr[l_index]);
                 inserted++;
                 l_index++;
             }
@@ -1023,9 +1614,10 @@ void Core::tick_outOrder()
         
         if (!stores_exe_flag)    // memory write requset send to memory. 
         {
-            while (trace_line.destAddr[s_index] != 0)
+            while (trace_line->destAddr[s_index] != 0)
             {
-                Request req(trace_line.destAddr[s_index], Request::Type::WRITE, callback, id, is_nmp);
+                Request req(trace_line->destAddr[s_index], Request::Type::WRITE, callback, id, is_nmp);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
                 s_index++;
             }
@@ -1036,22 +1628,21 @@ void Core::tick_outOrder()
     get_next_instruction();    // get the next trace line (or say instruction).
 
     // if trace line contain offloadble tag (ROI_BEGIN/ROI_END) or line reside in an offloadable region (inside_region flag), offloading operation perform.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0 || strcmp(trace_line.opcode, "ROI_END") == 0 || inside_region || configs.get_simulation_mode() == "MCP-Only")
+    if (trace_line->is_roi_marker() || inside_region || configs.get_simulation_mode() == "MCP-Only")
         offload_stratigy();
 
     // if limit of executed instruction reaches limit then finish and set reached_limit flag to true, also more_req set to false (to specify forefully that there no line exist).
-    if (long(own_proc->calculate_total_instruction() + 
-            nmp_proc->calculate_total_instruction() + 
-            nlp_proc->calculate_total_instruction()) >= expected_limit_insts 
-            && !reached_limit)
+    if (system_insts() + own_proc->sampler.skipped_insts >= expected_limit_insts && !reached_limit)
     {
         record_cycs = clk;
         record_insts = long(cpu_inst.value());
         memory.record_core(id);
         for (unsigned int index = 0; index < nlp_proc->cores.size(); index++)
             nlp_proc->cores[index]->more_reqs = false;
-        for (unsigned int index = 0; index < nmp_proc->cores.size(); index++)
-            nmp_proc->cores[index]->more_reqs = false;
+        nmp_proc->post(own_proc, [this]() {
+            for (unsigned int index = 0; index < nmp_proc->cores.size(); index++)
+                nmp_proc->cores[index]->more_reqs = false;
+        });
         for (unsigned int index = 0; index < own_proc->cores.size(); index++) {
             own_proc->cores[index]->reached_limit = true;
             own_proc->cores[index]->more_reqs = false;
@@ -1086,7 +1677,7 @@ void Core::offload_stratigy()
         host_only();
     else if (configs.get_simulation_mode() == "All-Offload")
         all_offload();
-    else if (configs.get_simulation_mode() == "Co-Simulation")
+    else if (configs.get_simulation_mode() == "Co-Simulation" || configs.get_simulation_mode() == "Oracle")
         compiler_assist_offload();
     else if (configs.get_simulation_mode() == "MCP-Only")
         nmp_only();
@@ -1100,7 +1691,7 @@ void Core::host_only()
     {
         valid = true;
         if (!get_next_instruction()) return;
-        if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0 || strcmp(trace_line.opcode, "ROI_END") == 0)    // offloadable tag will skip.
+        if (trace_line->is_roi_marker())    // offloadable tag will skip.
             valid = false;
     } while (!valid);   
 }
@@ -1108,14 +1699,14 @@ void Core::host_only()
 /* host core bypass all the instruction to the MCP PUs blindly (act like entire application execute by MCP side) */
 void Core::nmp_only()
 {
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0 || strcmp(trace_line.opcode, "ROI_END") == 0)    // if trace line contain tag then read next non-tag trace line.
+    if (trace_line->is_roi_marker())    // if trace line contain tag then read next non-tag trace line.
     {
         bool valid;
         do
         {
             valid = true;
             if (!get_next_instruction()) return;
-            if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0 || strcmp(trace_line.opcode, "ROI_END") == 0)    // offloadable tag will skip.
+            if (trace_line->is_roi_marker())    // offloadable tag will skip.
                 valid = false;   
         } while (!valid); 
     }
@@ -1129,65 +1720,65 @@ void Core::nmp_only()
 void Core::all_offload()
 {
     // when the instruction belong from an offloadable region, simply bypass and return.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") != 0 && strcmp(trace_line.opcode, "ROI_END") != 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)
+    if (!trace_line->is_roi_marker() && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)
     {
         instruction_bypass();
         return;
     }
 
     // when the instruction not belong to an offloadble region, will perform by host CPU but after completing the MCP side execution and return.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") != 0 && strcmp(trace_line.opcode, "ROI_END") != 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) == 0)
+    if (!trace_line->is_roi_marker() && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) == 0)
     {
         wait_for_nmp_finish = true;
-        lock_own_cores(trace_line.processID, false);
+        lock_own_cores(trace_line->processID, false);
         return;
     }
 
     // if the trace line contain ending offloadble tag then remove from the offading region set and reset the inside_region flag if set is empty.
-    if (strcmp(trace_line.opcode, "ROI_END") == 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)
+    if (trace_line->is_roi_end && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)
     {
-        offload_region_ids.erase(trace_line.regionID);
+        offload_region_ids.erase(trace_line->regionID);
         if (offload_region_ids.empty())
             inside_region = false;
     }
 
     // if the trace line contain starting offloadable tag then push the region id in offloading set, and lock the participating CPU core not perform any instruction further.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0)
+    if (trace_line->is_roi_begin)
     {
         decision_overhead_cycles += configs.get_overhead_cycle();    // decision-making overhead cycle added.
         record_region_count++;
         record_offload_region_count++;
-        offload_region_ids.insert(trace_line.regionID);     // offloaded region ID inserted added in offloading list.
+        offload_region_ids.insert(trace_line->regionID);     // offloaded region ID inserted added in offloading list.
         inside_region = true;
         nlp_core_id_gen = 0;    // re-inititiate NLP core ID to 0 (act like round-robin), futher well load balancing mechanism can be implemented.
-        lock_own_cores(trace_line.processID, true);
+        lock_own_cores(trace_line->processID, true);
     }
 
     // if prev line contain offloadable tag then, read the next trace line until the line contain an instruction.
     while (get_next_instruction())
     {
-        if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0)    // if the next line contain starting offloadbale tag then perform as previous.
+        if (trace_line->is_roi_begin)    // if the next line contain starting offloadbale tag then perform as previous.
         {
             record_region_count++;
             record_offload_region_count++;
             decision_overhead_cycles += configs.get_overhead_cycle();
-            offload_region_ids.insert(trace_line.regionID);
+            offload_region_ids.insert(trace_line->regionID);
             if (offload_region_ids.size() >= 1)
             {
                 inside_region = true;
                 nlp_core_id_gen= 0;
-                lock_own_cores(trace_line.processID, true);
+                lock_own_cores(trace_line->processID, true);
                 continue;
             }
         }
-        else if (strcmp(trace_line.opcode, "ROI_END") == 0 &&  offload_region_ids.count(trace_line.regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
+        else if (trace_line->is_roi_end &&  offload_region_ids.count(trace_line->regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
         {
-            offload_region_ids.erase(trace_line.regionID);
+            offload_region_ids.erase(trace_line->regionID);
             if (offload_region_ids.empty())
                 inside_region = false;
             continue;
         }
-        else if (!offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)    // if the next line contain instruction who belong to an offloading region then bypass.
+        else if (!offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)    // if the next line contain instruction who belong to an offloading region then bypass.
         {
             instruction_bypass();
             break;
@@ -1195,7 +1786,7 @@ void Core::all_offload()
         else    // otherwise perfom by host CPU, therefore unlocking the CPU cores.
         {
             if (inside_region) wait_for_nmp_finish = true;
-            lock_own_cores(trace_line.processID, false);
+            lock_own_cores(trace_line->processID, false);
             break;
         }
     }
@@ -1205,72 +1796,66 @@ void Core::all_offload()
 void Core::compiler_assist_offload()
 {
     // when the instruction belong from an offloadable region, simply bypass and return.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") != 0 && strcmp(trace_line.opcode, "ROI_END") != 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)
+    if (!trace_line->is_roi_marker() && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)
     {
         instruction_bypass();
         return;
     }
 
     // when the instruction not belong to an offloadble region, will perform by host CPU but after completing the MCP side execution and return.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") != 0 && strcmp(trace_line.opcode, "ROI_END") != 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) == 0)
+    if (!trace_line->is_roi_marker() && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) == 0)
     {
         wait_for_nmp_finish = true;
-        lock_own_cores(trace_line.processID, false);
+        lock_own_cores(trace_line->processID, false);
         return;
     }
 
     // if the trace line contain ending offloadble tag then remove from the offading region set and reset the inside_region flag if set is empty.
-    if (strcmp(trace_line.opcode, "ROI_END") == 0 && !offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)
+    if (trace_line->is_roi_end && !offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)
     {
-        offload_region_ids.erase(trace_line.regionID);
+        offload_region_ids.erase(trace_line->regionID);
         if (offload_region_ids.empty())
             inside_region = false;
     }
 
     // if the trace line contain starting offloadable tag then push the region id in offloading set, and lock the participating CPU core not perform any instruction further.
-    if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0)
+    if (trace_line->is_roi_begin)
     {
         record_region_count++;
-        std::vector<float> system_state = own_proc->collect_system_info();    // currently system stats are not using during decision-making process but can be used.
-        std::vector<float> bb_info_state = collect_basicblock_info(trace_line.regionID);    // collect basic block info using its region ID.
-
-        /* currently its only check the no of memory and non-memory inst. if more memory inst then it offload to MCP side */
-        if (bb_info_state[0] > bb_info_state[1]) {
+        if (offload_decision(trace_line->regionID)) {
             decision_overhead_cycles += configs.get_overhead_cycle();
             record_offload_region_count++;
-            offload_region_ids.insert(trace_line.regionID);
+            offload_region_ids.insert(trace_line->regionID);
             inside_region = true;
             nlp_core_id_gen = 0;
-            lock_own_cores(trace_line.processID, true);
+            lock_own_cores(trace_line->processID, true);
         }
     }
 
     // if prev line contain offloadable tag then, read the next trace line until the line contain an instruction.
     while (get_next_instruction())
     {
-        if (strcmp(trace_line.opcode, "ROI_BEGIN") == 0)    // if the next line contain starting offloadbale tag then perform as previous.
+        if (trace_line->is_roi_begin)    // if the next line contain starting offloadbale tag then perform as previous.
         {
             record_region_count++;
-            std::vector<float> system_state = own_proc->collect_system_info();
-            std::vector<float> bb_info_state = collect_basicblock_info(trace_line.regionID);
-            if (bb_info_state[0] > bb_info_state[1]) {
+            if (offload_decision(trace_line->regionID)) {
                 decision_overhead_cycles += configs.get_overhead_cycle();
                 record_offload_region_count++;
-                offload_region_ids.insert(trace_line.regionID);
+                offload_region_ids.insert(trace_line->regionID);
                 inside_region = true;
                 nlp_core_id_gen= 0;
-                lock_own_cores(trace_line.processID, true);
+                lock_own_cores(trace_line->processID, true);
             }
             continue;
         }
-        else if (strcmp(trace_line.opcode, "ROI_END") == 0 &&  offload_region_ids.count(trace_line.regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
+        else if (trace_line->is_roi_end &&  offload_region_ids.count(trace_line->regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
         {
-            offload_region_ids.erase(trace_line.regionID);
+            offload_region_ids.erase(trace_line->regionID);
             if (offload_region_ids.empty())
                 inside_region = false;
             continue;
         }
-        else if (!offload_region_ids.empty() && offload_region_ids.count(trace_line.regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
+        else if (!offload_region_ids.empty() && offload_region_ids.count(trace_line->regionID) > 0)    // if the next line contain ending offloadbale tag then perform as previous.
         {
             instruction_bypass();
             break;
@@ -1278,12 +1863,26 @@ void Core::compiler_assist_offload()
         else    // otherwise perfom by host CPU, therefore unlocking the CPU cores.
         {
             wait_for_nmp_finish = true;
-            lock_own_cores(trace_line.processID, false);
+            lock_own_cores(trace_line->processID, false);
             break;
         }
     }
 }
 
+/* decide on the offloading of the region beginning at the current line: run both ways by the Oracle mode, otherwise
+   from the compiler extracted information */
+bool Core::offload_decision(int regionID)
+{
+    if (configs.get_simulation_mode() == "Oracle")
+        return own_proc->oracle_decide(this, regionID);
+
+    std::vector<float> system_state = own_proc->collect_system_info();    // currently system stats are not using during decision-making process but can be used.
+    std::vector<float> bb_info_state = collect_basicblock_info(regionID);    // collect basic block info using its region ID.
+
+    /* currently its only check the no of memory and non-memory inst. if more memory inst then it offload to MCP side */
+    return bb_info_state[0] > bb_info_state[1];
+}
+
 /* it will load and initilize compiler extracted info */
 void Core::compiler_assist_setup(int procId)
 {
@@ -1325,7 +1924,7 @@ std::vector<float> Core::collect_basicblock_info(int blockID)
 /* this will bypass the instruction to MCP side queue */
 void Core::instruction_bypass()
 {
-    lock_own_cores(trace_line.processID, true);    // initially lock the all participating cores of CPU side.
+    lock_own_cores(trace_line->processID, true);    // initially lock the all participating cores of CPU side.
 
     bool read_dirty = false, write_dirty = false;     // reset the flags.
 
@@ -1333,15 +1932,15 @@ void Core::instruction_bypass()
     if (configs.get_nlp_facility() == "on")     
     { 
         int counter = 0;
-        while (trace_line.sourceAddr[counter] != 0)
+        while (trace_line->sourceAddr[counter] != 0)
         {
-            if (check_for_dirty(trace_line.sourceAddr[counter])) read_dirty = true;
+            if (check_for_dirty(trace_line->sourceAddr[counter])) read_dirty = true;
             ++counter;
         }
         counter = 0;
-        while (trace_line.destAddr[counter] != 0)
+        while (trace_line->destAddr[counter] != 0)
         {
-            if (check_for_dirty(trace_line.destAddr[counter])) write_dirty = true;
+            if (check_for_dirty(trace_line->destAddr[counter])) write_dirty = true;
             ++counter;
         }
     }
@@ -1349,62 +1948,55 @@ void Core::instruction_bypass()
     // if dirty data found then instruction will added to NLP cores otherwise NMP cores. (this can be extended using &&).
     if (read_dirty || write_dirty)
     {
-        int dist_nlp_core_id = nlp_core_id_gen % configs.get_nlp_core_num();    // get the ID of NLP core.
-
-        // if the queue is full then return and wait for next tick utill it find vacant.
-        if (configs.get_nmp_core_queue_max_size() != 0 && nlp_proc->cores[dist_nlp_core_id]->inst_queue.numberInstructionsInQueue >= configs.get_nmp_core_queue_max_size())
-        {
-            pending_inst_bypass = true;
-            return;
-        }
-        nlp_proc->cores[dist_nlp_core_id]->inst_queue.trace_queue.push_back(trace_line);    // inserting instruction in queue.
-        nlp_proc->cores[dist_nlp_core_id]->inst_queue.numberInstructionsInQueue++;    // count the queued instruction.
+        bypass_target = nlp_proc->cores[nlp_core_id_gen % configs.get_nlp_core_num()].get();
         nlp_core_id_gen++;    // increment for getting next NLP core (as round-robin).
-        pending_inst_bypass = false;
-        nmp_proc->lock_all_cores(true);    // lock all the NMP cores until NLP finish its task to simulate consistency.
     }
     else    // otherwise insert the instruction to the NMP core whos corrosponding vault has the instruction.
+        bypass_target = nmp_proc->cores[get_vault_target(trace_line->instPointer)].get();
+    offload_pending();
+}
+
+/* hand the instruction to the PU chosen by instruction_bypass, if the queue is full then wait for next tick utill it
+   find vacant (only its credit is checked again) */
+void Core::offload_pending()
+{
+    pending_inst_bypass = !bypass_target->can_take_offload(own_proc);
+    if (pending_inst_bypass)
+        return;
+    bypass_target->take_offload(own_proc, *trace_line);    // inserting instruction in queue (takes a credit).
+    if (bypass_target->nlp_side)
+        nmp_proc->post(own_proc, [this]() { nmp_proc->lock_all_cores(true); });    // lock all the NMP cores until NLP finish its task to simulate consistency.
+    bypass_target = nullptr;
+}
+
+/* whether a core of the from side may offload an instruction here, by the length it sees while the sides run apart */
+bool Core::can_take_offload(const Processor* from)
+{
+    return own_proc->across(from) ? inst_queue.has_seen_credit() : inst_queue.has_credit();
+}
+
+/* queue an instruction offloaded by a core of the from side (at the next quantum boundary while the sides run apart) */
+void Core::take_offload(const Processor* from, const trace_instruction& line)
+{
+    if (!own_proc->across(from))
     {
-        Core *nmp_core = nmp_proc->cores[get_vault_target(trace_line.instPointer)].get();
-        if (configs.get_nmp_core_queue_max_size() != 0 && nmp_core->inst_queue.numberInstructionsInQueue >= configs.get_nmp_core_queue_max_size())
-        {
-            pending_inst_bypass = true;
-            return;
-        }
-        nmp_core->inst_queue.trace_queue.push_back(trace_line);
-        nmp_core->inst_queue.numberInstructionsInQueue++;
-        pending_inst_bypass = false;
+        inst_queue.push_back() = line;
+        return;
     }
+    inst_queue.seen_length++;
+    own_proc->post(from, [this, line]() { inst_queue.push_back(line); });
 }
 
 /* check the current address (addr) is dirty at level LLC or not (return true/false) */
 bool Core::check_for_dirty(long addr)
 {
-    auto it =  llc->cache_lines.find(llc->get_index(addr));
-    if(it != llc->cache_lines.end()){
-        auto& lines = it->second;
-        for(auto it = lines.begin(); it != lines.end(); ++it){
-            if(it->tag == llc->get_tag(addr)){
-                if(it->dirty == true) {
-                    return true;
-                }
-            }
-        }
-    }
-    return false;
+    return llc->is_dirty(addr);
 }
 
 /* get the mmeory vault address where the requesting address (mem_addr) is reside */
 int Core::get_vault_target(long mem_addr)
 {
-    MemoryBase *ptr_mem = &memory;
-    Memory<HMC, Controller> *ptr = dynamic_cast<Memory<HMC, Controller> *>(ptr_mem);
-    ptr->clear_higher_bits(mem_addr, ptr->max_address - 1ll);
-    ptr->clear_lower_bits(mem_addr, ptr->tx_bits);
-    int max_block_col_bits = ptr->spec->maxblock_entry.flit_num_bits - ptr->tx_bits;
-    ptr->slice_lower_bits(mem_addr, max_block_col_bits);
-    int vault_target = ptr->slice_lower_bits(mem_addr, ptr->addr_bits[int(HMC::Level::Vault)]);
-    return vault_target;
+    return memory.get_vault_target(mem_addr);
 }
 
 /* this is used to lock/unlock the cores (using flag) which executing the current process (using processID) */
@@ -1424,28 +2016,30 @@ void Core::tick_inOrder()
 
     if (inFlightMemoryAccess >= 1) return;
 
+    if (own_proc->draining) return;
+
     // if NMP side, then after NLP finish NMP cores will be unloacked to execute further.
     if (configs.get_nlp_facility() == "on" && !nlp_side) {
-        if (!nlp_proc->can_nmp_switch()) { idle_cycles++; return; }
+        if (!nlp_proc->seen_nmp_switch(own_proc)) { idle_cycles++; return; }
         else lock_core = false;
     }
 
     if (lock_core) { idle_cycles++; return; }    // if locked then consume idle cycle.
 
     // if NLP side, then after NMP's request completion NLP cores will be execute further.
-    if (nlp_side) if (!nmp_proc->can_nmp_switch()) { idle_cycles++; return; }
+    if (nlp_side) if (!nmp_proc->seen_nmp_switch(own_proc)) { idle_cycles++; return; }
 
     // begin to execute the instruction (remining workflow are same as OoO).
-    if (trace_line.instPointer != 0)
+    if (trace_line->instPointer != 0)
     {
         if (configs.inst_fetching() == "on")    // if instruction fetching as an read req is enable then it send to memory.
         {
-            Request req(trace_line.instPointer, Request::Type::READ, callback, id, is_nmp);
+            Request req(trace_line->instPointer, Request::Type::READ, callback, id, is_nmp);
             req.instruction_request = true;
             if (!send(req)) { idle_cycles++; return; }
             inFlightMemoryAccess++;
         } else ++bubble_cnt;    // otherwise just consume one cycle (bubble_cnt) becz this simulator does not have icache concept properly.
-        trace_line.instPointer = 0;
+        trace_line->instPointer = 0;
         cpu_inst++;
         if (!loads_exe_flag || !stores_exe_flag) memory_inst++;
         if (configs.inst_fetching() == "on") return;
@@ -1462,17 +2056,19 @@ void Core::tick_inOrder()
 
     if (!loads_exe_flag)
     {
-        while (trace_line.sourceAddr[l_index] != 0)
+        while (trace_line->sourceAddr[l_index] != 0)
         {
             if (inserted == window.ipc) { idle_cycles++; return; }
-            if (get_vault_target(trace_line.sourceAddr[l_index]) == own_vault_target_addr)
+            if (get_vault_target(trace_line->sourceAddr[l_index]) == own_vault_target_addr)
             {
-                Request req(trace_line.sourceAddr[l_index], Request::Type::READ, callback, id, is_nmp);
+                Request req(trace_line->sourceAddr[l_index], Request::Type::READ, callback, id, is_nmp);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
             }
             else
             {
-                Request req(trace_line.sourceAddr[l_index], Request::Type::READ, callback, id, false);
+                Request req(trace_line->sourceAddr[l_index], Request::Type::READ, callback, id, false);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
             }
             inserted++;
@@ -1483,16 +2079,18 @@ void Core::tick_inOrder()
     
     if (!stores_exe_flag)
     {
-        while (trace_line.destAddr[s_index] != 0)
+        while (trace_line->destAddr[s_index] != 0)
         {
-            if (get_vault_target(trace_line.destAddr[s_index]) == own_vault_target_addr)
+            if (get_vault_target(trace_line->destAddr[s_index]) == own_vault_target_addr)
             {
-                Request req(trace_line.destAddr[s_index], Request::Type::WRITE, callback, id, is_nmp);
+                Request req(trace_line->destAddr[s_index], Request::Type::WRITE, callback, id, is_nmp);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
             }
             else
             {
-                Request req(trace_line.destAddr[s_index], Request::Type::WRITE, callback, id, false);
+                Request req(trace_line->destAddr[s_index], Request::Type::WRITE, callback, id, false);
+                req.pc = inst_pc;
                 if (!send(req)) { idle_cycles++; return; }
             }
             s_index++;
@@ -1518,10 +2116,39 @@ void Core::tick()
 /* calculate and show the weightage IPC for the core */
 double Core::calc_ipc()
 {
+    wake();
     printf("[%d]retired: %ld, clk, %ld\n", id, retired, clk);
     return (double)retired / clk;
 }
 
+/* an in-order core without an instruction only counts idle cycles, so it can leave the processor tick */
+bool Core::can_sleep()
+{
+    return !more_reqs && cpu_type == "inOrder";
+}
+
+/* leave the processor tick, starting with the current one */
+void Core::sleep()
+{
+    sleeping = true;
+    slept_at = long(own_proc->cpu_cycles.value());
+}
+
+/* account the ticks skipped since sleep(): every processor tick up to the current one, unless the processor is
+   ticking and has not reached this core yet */
+void Core::wake()
+{
+    if (!sleeping)
+        return;
+    unsigned int index = id - own_proc->initial_core_id;
+    long skipped = long(own_proc->cpu_cycles.value()) - slept_at + 1;
+    if (index > own_proc->ticking_core)
+        --skipped;
+    clk += skipped;
+    idle_cycles += skipped;
+    sleeping = false;
+}
+
 /* return the core has more instruction to execute or not */
 bool Core::finished()
 {
@@ -1568,6 +2195,112 @@ long Core::get_executed_insts()
     return long(cpu_inst.value());
 }
 
+/* execute the current trace line functionally and load the next one: the caches (if warm) and the page mapping are
+   updated, no time passes and no statistic counts it. False when the core has no line. */
+bool Core::fast_forward(bool warm)
+{
+    if (!more_reqs)
+        return false;
+
+    if (!trace_line->is_roi_marker())
+    {
+        Cache *target = (first_level_cache != nullptr) ? first_level_cache : llc;
+        if (warm && target != nullptr)
+        {
+            if (configs.inst_fetching() == "on" && trace_line->instPointer != 0)
+                target->warm(trace_line->instPointer, false, id);
+            for (int i = 0; i < NUM_INSTR_SOURCES && trace_line->sourceAddr[i] != 0; i++)
+                target->warm(trace_line->sourceAddr[i], false, id);
+            for (int i = 0; i < NUM_INSTR_DESTINATIONS && trace_line->destAddr[i] != 0; i++)
+                target->warm(trace_line->destAddr[i], true, id);
+        }
+        fast_forwarded++;
+    }
+
+    get_next_instruction();
+    if (more_reqs)
+        execution_flag_set();
+    else if (!reached_limit)
+    {
+        record_cycs = clk;
+        record_insts = long(cpu_inst.value());
+        memory.record_core(id);
+        reached_limit = true;
+    }
+    return true;
+}
+
+/* true when no miss of the core's caches is pending. The window and the fetch counter are saved as they are: once
+   the caches and the memory are empty, what they still wait for was merged into another core's MSHR and is not answered */
+bool Core::drained()
+{
+    for (auto &cache : caches)
+        if (!cache->mshr_entries.empty() || !cache->retry_list.empty())
+            return false;
+    return true;
+}
+
+/* save or restore the core (drained): execution state, the pending trace lines, the private caches and the trace position */
+void Core::checkpoint(Checkpoint &cp)
+{
+    cp.io(clk);
+    cp.io(retired);
+    cp.io(inFlightMemoryAccess);
+    cp.io(lock_core);
+    cp.io(bubble_cnt);
+    cp.io(req_addr);
+    cp.io(req_type);
+    cp.io(region_id);
+    cp.io(more_reqs);
+    cp.io(last);
+    cp.io(reached_limit);
+    cp.io(inside_region);
+    cp.io(is_warmup_done);
+    cp.io(pending_inst_bypass);
+    long target = (bypass_target != nullptr) ? bypass_target->id : -1;
+    cp.io(target);
+    if (cp.restoring)
+    {
+        // a host core waiting for the credit of a PU of the NMP or the NLP side.
+        bypass_target = nullptr;
+        if (target >= 0)
+            for (Processor *side : {nmp_proc, nlp_proc})
+                if (side != nullptr)
+                    for (auto &core : side->cores)
+                        if (core->id == target) bypass_target = core.get();
+    }
+    cp.io(wait_for_nmp_finish);
+    cp.io(decision_overhead_cycles);
+    cp.io(l_index);
+    cp.io(s_index);
+    cp.io(deployed_app_id);
+    cp.io(current_thread_id);
+    cp.io(proc_switching_flag);
+    cp.io(nlp_core_id_gen);
+    cp.io(loads_exe_flag);
+    cp.io(stores_exe_flag);
+    cp.io(sleeping);
+    cp.io(slept_at);
+    cp.io(offload_region_ids);
+    if (cp.restoring && held != InstructionPool::NONE)
+    {
+        inst_queue.pool->release(held);
+        held = InstructionPool::NONE;
+        trace_line = &own_line;
+    }
+    cp.io(*trace_line);
+    cp.io(inst_pc);
+    inst_queue.checkpoint(cp);
+    window.checkpoint(cp);
+
+    cp.expect(caches.size(), "private caches of a core");
+    for (auto &cache : caches)
+        cache->checkpoint(cp);
+    cp.expect(trace_assigned, "trace of a core");
+    if (trace_assigned)
+        trace_per_core.checkpoint(cp);
+}
+
 
 /* check OoO window is full or not */
 bool Window::is_full()
@@ -1641,34 +2374,674 @@ void Window::reset_window()
 }
 
 
+/* save or restore the entries of the window */
+void Window::checkpoint(Checkpoint &cp)
+{
+    cp.expect(depth, "window depth");
+    cp.io(load);
+    cp.io(head);
+    cp.io(tail);
+    cp.io(ready_list);
+    cp.io(addr_list);
+}
+
 /* trace interface */
 Trace::Trace(const string &trace_fname) : trace_name(trace_fname)
 { }
 
+TraceRing::TraceRing(size_t entries) : ended(false), head(0), tail(0)
+{
+    size_t size = 1;
+    while (size < entries) size <<= 1;
+    slots.resize(size);
+    mask = size - 1;
+}
+
+bool TraceRing::pop(trace_instruction &line)
+{
+    size_t at = head.load(std::memory_order_relaxed);
+    if (at == tail.load(std::memory_order_acquire))
+        return false;
+    line = slots[at & mask];
+    head.store(at + 1, std::memory_order_release);
+    return true;
+}
+
+TraceDecodePool& TraceDecodePool::instance()
+{
+    static TraceDecodePool pool;
+    return pool;
+}
+
+TraceDecodePool::~TraceDecodePool()
+{
+    stopping = true;
+    for (auto &worker : workers)
+        worker->thread.join();
+}
+
+/* hand a trace to the least recently assigned worker, the first call starts the workers */
+void TraceDecodePool::attach(Trace* trace, int count)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    while (int(workers.size()) < count)
+    {
+        workers.emplace_back(new Worker());
+        Worker *worker = workers.back().get();
+        worker->thread = std::thread(&TraceDecodePool::run, this, worker);
+    }
+    Worker *worker = workers[next_worker++ % workers.size()].get();
+    std::lock_guard<std::mutex> worker_guard(worker->lock);
+    worker->traces.push_back(trace);
+}
+
+void TraceDecodePool::detach(Trace* trace)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &worker : workers)
+    {
+        std::lock_guard<std::mutex> worker_guard(worker->lock);
+        worker->traces.erase(std::remove(worker->traces.begin(), worker->traces.end(), trace), worker->traces.end());
+    }
+}
+
+/* keep the rings of the worker's traces topped up, back off briefly when all of them are full */
+void TraceDecodePool::run(Worker* worker)
+{
+    while (!stopping)
+    {
+        bool added = false;
+        {
+            std::lock_guard<std::mutex> guard(worker->lock);
+            for (Trace *trace : worker->traces)
+                added |= trace->fill_ring();
+        }
+        if (!added)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+/* the shared streams of a sweep, by trace file name (a null stream for a file that can not be opened) */
+struct SharedTraces {
+    std::mutex lock;
+    bool enabled = false;
+    std::map<string, std::shared_ptr<SharedTraceStream>> streams;
+
+    static SharedTraces& instance()
+    {
+        static SharedTraces traces;
+        return traces;
+    }
+};
+
+void SharedTraceStream::enable()
+{
+    std::lock_guard<std::mutex> guard(SharedTraces::instance().lock);
+    SharedTraces::instance().enabled = true;
+}
+
+void SharedTraceStream::release_starts()
+{
+    std::lock_guard<std::mutex> guard(SharedTraces::instance().lock);
+    for (auto &entry : SharedTraces::instance().streams)
+        if (entry.second)
+            entry.second->first.reset();
+}
+
+/* the stream of the file, opened (with the configuration of the first simulator asking) on first use. Null when
+   sharing is off or the file can not be read. */
+std::shared_ptr<SharedTraceStream> SharedTraceStream::attach(const string& trace_fname, const Config& configs)
+{
+    SharedTraces &traces = SharedTraces::instance();
+    std::lock_guard<std::mutex> guard(traces.lock);
+    if (!traces.enabled)
+        return nullptr;
+    auto found = traces.streams.find(trace_fname);
+    if (found != traces.streams.end())
+        return found->second;
+
+    std::shared_ptr<SharedTraceStream> stream(new SharedTraceStream());
+    stream->reader.reset(new Trace());
+    stream->reader->shareable = false;
+    stream->first = std::make_shared<Block>();
+    if (!stream->reader->init_trace(trace_fname, configs))
+        stream = nullptr;
+    traces.streams[trace_fname] = stream;
+    return stream;
+}
+
+/* the next line after pos in block, decoding the next block when the reader is the first to get there */
+bool SharedTraceStream::next(std::shared_ptr<Block>& block, size_t& pos, trace_instruction& line)
+{
+    while (pos == block->lines.size())
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!block->next)
+        {
+            if (ended)
+                return false;
+            std::shared_ptr<Block> decoded = std::make_shared<Block>();
+            decoded->lines.resize(BLOCK_LINES);
+            size_t count = 0;
+            while (count < BLOCK_LINES && reader->get_trace_line(decoded->lines[count]))
+                count++;
+            decoded->lines.resize(count);
+            ended = (count < BLOCK_LINES);
+            block->next = decoded;
+        }
+        block = block->next;
+        pos = 0;
+    }
+    line = block->lines[pos++];
+    return true;
+}
+
+/* decode into the ring until it is full or the trace ends */
+bool Trace::fill_ring()
+{
+    bool added = false;
+    while (!ring->ended.load(std::memory_order_relaxed) && !ring->full())
+    {
+        if (!decode_line(ring->next_slot()))
+        {
+            ring->ended.store(true, std::memory_order_release);
+            break;
+        }
+        ring->publish();
+        added = true;
+    }
+    return added;
+}
+
+/* release the trace mapping or the stream */
+Trace::~Trace()
+{
+    if (ring)
+        TraceDecodePool::instance().detach(this);    // stop decoding before the input goes away.
+    inflight_chunks.clear();    // wait for chunks still inflating from the mapping.
+    if (mapped != nullptr)
+        munmap(const_cast<char *>(mapped), mapped_size);
+    if (file != NULL)
+        fclose(file);
+}
+
 /* initilaize the trace file for corrosponding core */
 bool Trace::init_trace(const string &trace_fname, const Config &configs)
 {
     this->configs = configs;
     trace_name = trace_fname;
-    file = fopen(trace_name.c_str(), "rb");
-    if (file == NULL)
+    readahead_window = configs.get_trace_readahead_window();
+
+    // in a sweep the lines come decoded from the stream of the file.
+    if (shareable)
+        shared = SharedTraceStream::attach(trace_fname, configs);
+    if (shared)
+    {
+        shared_block = shared->start();
+        summary = shared->source().summary;
+        has_summary = shared->source().has_summary;
+        return shared_block != nullptr;
+    }
+
+    int fd = open(trace_name.c_str(), O_RDONLY);
+    if (fd < 0)
     {
         // std::cerr << "Bad trace file: " << trace_fname << std::endl;
         return false;
     }
-    cout << "Trace opended: " << trace_fname << endl;
+
+    // regular files are memory-mapped, pipes (or trace_reader = stream) fall back to the FILE* reader.
+    string backend = "";
+    if (configs.get_trace_reader() == "mmap" && map_trace(fd))
+    {
+        close(fd);
+        backend = " (mmap)";
+    }
+    else
+    {
+        file = fdopen(fd, "rb");
+        if (file == NULL)
+        {
+            close(fd);
+            return false;
+        }
+        stream_buffer.resize(1 << 20);
+    }
+
+    // v1 traces are headerless, later versions start with a file header (and optionally the trace summary).
+    size_t readable = available(sizeof(trace_file_header) + sizeof(trace_summary));
+    const uint8_t *header = reinterpret_cast<const uint8_t *>(cursor());
+    format_version = trace_codec::read_header(header, readable);
+    has_summary = trace_codec::read_summary(header, readable, summary);
+    consume(trace_codec::header_size(header, readable));
+    if (format_version != TRACE_FORMAT_V1 && format_version != TRACE_FORMAT_V2 && format_version != TRACE_FORMAT_V3)
+    {
+        std::cerr << "Unsupported trace format version " << format_version << ": " << trace_fname << std::endl;
+        return false;
+    }
+
+    // chunked traces are read through their footer index, which needs a seekable file.
+    if (format_version == TRACE_FORMAT_V3)
+    {
+        bool indexed = (mapped != nullptr) ? chunk_index.load(reinterpret_cast<const uint8_t *>(mapped), mapped_size)
+                                           : chunk_index.load(file);
+        if (!indexed)
+        {
+            std::cerr << "Bad chunk index (chunked traces need a seekable file): " << trace_fname << std::endl;
+            return false;
+        }
+        decode_threads = max(1, configs.get_trace_decode_threads());
+    }
+
+    cout << "Trace opended" << backend << ": " << trace_fname << " (format v" << format_version << ")" << endl;
+    if (has_summary)
+    {
+        cout << "Trace summary: " << summary.instruction_count << " instructions, " << summary.roi_count << " ROIs, "
+             << summary.thread_count << " threads (process " << summary.processID << ")" << endl;
+        decoder.reserve_threads(summary.thread_count);
+        progress_step = max<uint64_t>(1, summary.record_count / 10);
+        next_progress = progress_step;
+    }
+    if (!seek_start(configs))
+        return false;
+
+    // decoding continues on the worker threads from the start position.
+    int workers = configs.get_trace_decode_workers();
+    if (workers > 0)
+    {
+        ring.reset(new TraceRing(configs.get_trace_ring_entries()));
+        TraceDecodePool::instance().attach(this, workers);
+    }
     return true;
 }
 
-/* read the trace line from tarce file */
-bool Trace::get_trace_line(trace_format &trace_line)
+/* position the trace at the configured start (instruction number or k-th instance of a region) */
+bool Trace::seek_start(const Config &configs)
 {
-    if (file != NULL)
-        if (fread(&trace_line, sizeof(trace_format), 1, file))
-            return true;
+    long start_inst = configs.get_trace_start_inst();
+    long start_region = configs.get_trace_start_region();
+    long instance = configs.get_trace_start_region_instance();
+    if (start_inst == 0 && start_region < 0)
+        return true;
+
+    // the index of a chunked trace resolves both kinds of start directly.
+    if (format_version == TRACE_FORMAT_V3)
+    {
+        uint64_t record = start_inst;
+        if (start_region >= 0 && !chunk_index.find_region(start_region, instance, record))
+        {
+            std::cerr << "Trace " << trace_name << " has less than " << instance << " instances of region " << start_region << std::endl;
+            return false;
+        }
+        next_chunk = chunk_index.find_record(record);
+        if (next_chunk == chunk_index.chunks.size())
+        {
+            std::cerr << "Trace " << trace_name << " ends before instruction " << record << std::endl;
+            return false;
+        }
+        uint64_t skip = record - chunk_index.chunks[next_chunk].first_record;
+        for (uint64_t i = 0; i < skip; i++)
+            next_trace_line();
+        skip_progress(record);
+        cout << "Trace " << trace_name << " starts at instruction " << record << endl;
+        return true;
+    }
 
-    return false;
+    // raw records can be skipped by offset.
+    if (start_region < 0 && format_version == TRACE_FORMAT_V1 && mapped != nullptr)
+    {
+        read_offset = min(mapped_size, size_t(start_inst) * sizeof(trace_format));
+        advance_readahead();
+        skip_progress(start_inst);
+        cout << "Trace " << trace_name << " starts at instruction " << start_inst << endl;
+        return true;
+    }
+
+    // otherwise decode up to the start.
+    long record = 0;
+    const trace_format *line = nullptr;
+    if (start_region < 0)
+    {
+        for (; record < start_inst; record++)
+            if (next_trace_line() == nullptr) break;
+    }
+    else
+    {
+        while ((line = next_trace_line()) != nullptr)
+        {
+            if (line->regionID == uint64_t(start_region) && strcmp(line->opcode, "ROI_BEGIN") == 0 && --instance == 0)
+                break;
+            record++;
+        }
+        if (line == nullptr)
+        {
+            std::cerr << "Trace " << trace_name << " has less instances of region " << start_region << std::endl;
+            return false;
+        }
+        decoded_line = *line;
+        replay_line = true;    // the ROI_BEGIN marker is the first line handed out.
+    }
+    skip_progress(record);
+    cout << "Trace " << trace_name << " starts at instruction " << record << endl;
+    return true;
 }
 
+/* account for records skipped before the start of the simulation */
+void Trace::skip_progress(uint64_t records)
+{
+    records_read = records;
+    while (progress_step != 0 && next_progress <= records_read)
+        next_progress += progress_step;
+}
+
+/* save the position of the core in the trace, the restored trace continues from it */
+void Trace::checkpoint(Checkpoint &cp)
+{
+    cp.expect(has_summary ? long(summary.record_count) : -1, "records of the trace");
+    uint64_t record = records_read;
+    cp.io(record);
+    if (cp.restoring && !seek_record(record))
+        cp.fail("trace " + trace_name + " ends before record " + to_string(record));
+}
+
+/* skip the freshly opened trace forward to a record: whole chunks by the index, raw records by offset, the rest is
+   decoded (a ROI_BEGIN waiting to be replayed or a filled ring are read like the core would) */
+bool Trace::seek_record(uint64_t record)
+{
+    if (record < records_read)
+        return false;
+    if (!ring && !replay_line && format_version == TRACE_FORMAT_V3)
+    {
+        next_chunk = chunk_index.find_record(record);
+        inflight_chunks.clear();
+        chunk_data.clear();
+        chunk_pos = 0;
+        if (next_chunk < chunk_index.chunks.size())
+        {
+            uint64_t skip = record - chunk_index.chunks[next_chunk].first_record;
+            for (uint64_t i = 0; i < skip; i++)
+                next_trace_line();
+        }
+        skip_progress(record);
+        return true;
+    }
+    if (!ring && !replay_line && format_version == TRACE_FORMAT_V1 && mapped != nullptr)
+    {
+        read_offset = min(mapped_size, size_t(record) * sizeof(trace_format));
+        advance_readahead();
+        skip_progress(record);
+        return true;
+    }
+
+    trace_instruction line;
+    while (records_read < record)
+        if (!get_trace_line(line))
+            return false;
+    return true;
+}
+
+void Trace::settle()
+{
+    for (auto &chunk : inflight_chunks)
+        chunk.wait();
+}
+
+/* keep decode_threads chunks being inflated in the background */
+void Trace::schedule_chunks()
+{
+    while (inflight_chunks.size() < decode_threads && next_chunk < chunk_index.chunks.size())
+    {
+        const trace_chunk_entry entry = chunk_index.chunks[next_chunk++];
+        std::shared_ptr<std::vector<uint8_t>> compressed;
+        const uint8_t *source;
+        if (mapped != nullptr)
+        {
+            source = reinterpret_cast<const uint8_t *>(mapped) + entry.offset;
+            madvise(const_cast<char *>(mapped) + (entry.offset & ~(uint64_t(sysconf(_SC_PAGESIZE)) - 1)),
+                    entry.compressed_size + (entry.offset & (sysconf(_SC_PAGESIZE) - 1)), MADV_WILLNEED);
+        }
+        else
+        {
+            // the FILE* is only touched from this thread.
+            compressed = std::make_shared<std::vector<uint8_t>>(entry.compressed_size);
+            if (fseeko(file, entry.offset, SEEK_SET) != 0 || fread(compressed->data(), 1, compressed->size(), file) != compressed->size())
+                compressed->clear();
+            source = compressed->data();
+        }
+        inflight_chunks.push_back(std::async(std::launch::async, [entry, source, compressed]() {
+            std::vector<uint8_t> raw;
+            if ((compressed && compressed->size() != entry.compressed_size) || !trace_codec::inflate_chunk(source, entry, raw))
+                raw.clear();
+            return raw;
+        }));
+    }
+}
+
+/* switch to the next inflated chunk, false at the end of trace */
+bool Trace::load_next_chunk()
+{
+    schedule_chunks();
+    if (inflight_chunks.empty())
+        return false;
+
+    chunk_data = inflight_chunks.front().get();
+    inflight_chunks.pop_front();
+    chunk_pos = 0;
+    decoder = trace_codec::Decoder();    // every chunk restarts the delta and opcode state.
+    opcode_cache.clear();
+    schedule_chunks();
+
+    if (chunk_data.empty())
+    {
+        std::cerr << "Damaged chunk in trace " << trace_name << std::endl;
+        inflight_chunks.clear();
+        next_chunk = chunk_index.chunks.size();
+        return false;
+    }
+    return true;
+}
 
-  
\ No newline at end of file
+/* map the whole trace file read-only and advise the kernel about sequential access */
+bool Trace::map_trace(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    mapped_size = size_t(st.st_size);
+    if (mapped_size == 0)
+        return false;
+
+    void *addr = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        mapped_size = 0;
+        return false;
+    }
+
+    mapped = static_cast<const char *>(addr);
+    madvise(addr, mapped_size, MADV_SEQUENTIAL);
+    read_offset = 0;
+    readahead_offset = 0;
+    released_offset = 0;
+    advance_readahead();
+    return true;
+}
+
+/* keep one read-ahead window in flight in front of the reader and drop the pages already consumed */
+void Trace::advance_readahead()
+{
+    if (readahead_window == 0)
+    {
+        advise_offset = mapped_size;
+        return;
+    }
+
+    const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+
+    // top up the window so that [read_offset, read_offset + readahead_window) is being read in.
+    size_t end = min(mapped_size, read_offset + readahead_window);
+    if (end > readahead_offset)
+    {
+        size_t begin = readahead_offset & ~(page_size - 1);
+        madvise(const_cast<char *>(mapped) + begin, end - begin, MADV_WILLNEED);
+        readahead_offset = end;
+    }
+
+    // release the pages behind the reader so resident memory stays bounded on very long traces.
+    size_t consumed = read_offset & ~(page_size - 1);
+    if (consumed >= released_offset + readahead_window)
+    {
+        madvise(const_cast<char *>(mapped) + released_offset, consumed - released_offset, MADV_DONTNEED);
+        released_offset = consumed;
+    }
+
+    // come back after a quarter of the window has been consumed.
+    advise_offset = read_offset + max(readahead_window / 4, page_size);
+}
+
+/* number of readable bytes at the cursor, the stream buffer is refilled when less than need bytes are left */
+size_t Trace::available(size_t need)
+{
+    if (mapped != nullptr)
+        return mapped_size - read_offset;
+
+    size_t left = stream_end - stream_pos;
+    if (left >= need || file == NULL)
+        return left;
+
+    memmove(&stream_buffer[0], &stream_buffer[stream_pos], left);
+    stream_pos = 0;
+    stream_end = left + fread(&stream_buffer[left], 1, stream_buffer.size() - left, file);
+    return stream_end;
+}
+
+/* pointer to the first unread byte */
+const char *Trace::cursor() const
+{
+    if (mapped != nullptr)
+        return mapped + read_offset;
+    return stream_buffer.data() + stream_pos;
+}
+
+/* mark bytes as read */
+void Trace::consume(size_t bytes)
+{
+    if (mapped != nullptr)
+    {
+        read_offset += bytes;
+        if (read_offset >= advise_offset)
+            advance_readahead();
+    }
+    else
+        stream_pos += bytes;
+}
+
+/* return a pointer to the next trace line, it stays valid until the next call */
+const trace_format *Trace::next_trace_line()
+{
+    if (replay_line)
+    {
+        replay_line = false;
+        return &decoded_line;
+    }
+
+    if (format_version == TRACE_FORMAT_V3)
+    {
+        while (chunk_pos >= chunk_data.size())
+            if (!load_next_chunk())
+                return nullptr;
+        size_t used = decoder.decode(chunk_data.data() + chunk_pos, chunk_data.size() - chunk_pos, decoded_line);
+        if (used == 0)
+            return nullptr;
+        chunk_pos += used;
+        decoded_opcode = decoder.opcode_index();
+        return &decoded_line;
+    }
+
+    if (format_version == TRACE_FORMAT_V1)
+    {
+        if (available(sizeof(trace_format)) < sizeof(trace_format))
+            return nullptr;
+        const char *line = cursor();
+        consume(sizeof(trace_format));
+        if (mapped != nullptr)
+            return reinterpret_cast<const trace_format *>(line);
+        memcpy(&decoded_line, line, sizeof(trace_format));
+        return &decoded_line;
+    }
+
+    size_t length = available(TRACE_V2_MAX_RECORD_SIZE);
+    size_t used = decoder.decode(reinterpret_cast<const uint8_t *>(cursor()), length, decoded_line);
+    if (used == 0)
+        return nullptr;    // end of trace (a truncated last record is dropped).
+    consume(used);
+    decoded_opcode = decoder.opcode_index();
+    return &decoded_line;
+}
+
+/* read the trace line from tarce file (or from the ring filled by the decode workers) */
+bool Trace::get_trace_line(trace_instruction &trace_line)
+{
+    if (shared)
+    {
+        if (!shared->next(shared_block, shared_pos, trace_line))
+            return false;
+    }
+    else if (ring)
+    {
+        while (!ring->pop(trace_line))
+        {
+            if (ring->ended.load(std::memory_order_acquire))
+            {
+                if (!ring->pop(trace_line)) return false;    // the last lines may land just before ended.
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+    else if (!decode_line(trace_line))
+        return false;
+
+    if (++records_read == next_progress)
+    {
+        cout << "Trace " << trace_name << ": " << 100 * records_read / summary.record_count << "% ("
+             << records_read << " of " << summary.record_count << " records)" << endl;
+        next_progress += progress_step;
+    }
+    return true;
+}
+
+/* decode and classify the next trace line */
+bool Trace::decode_line(trace_instruction &trace_line)
+{
+    const trace_format *line = next_trace_line();
+    if (line == nullptr)
+        return false;
+
+    static_cast<trace_format &>(trace_line) = *line;
+
+    // resolve the opcode once per dictionary entry (v2/v3) or per distinct name (v1).
+    OpcodeTable::Info info;
+    if (decoded_opcode >= 0)
+    {
+        if (size_t(decoded_opcode) >= opcode_cache.size())
+            opcode_cache.resize(decoded_opcode + 1, OpcodeTable::Info{-1, 0});
+        if (opcode_cache[decoded_opcode].id < 0)
+            opcode_cache[decoded_opcode] = OpcodeTable::instance().intern(line->opcode, strnlen(line->opcode, MAX_OPCODE_LENGTH));
+        info = opcode_cache[decoded_opcode];
+    }
+    else
+    {
+        std::string name(line->opcode, strnlen(line->opcode, MAX_OPCODE_LENGTH));
+        auto cached = opcode_names.find(name);
+        if (cached == opcode_names.end())
+            cached = opcode_names.insert(std::make_pair(name, OpcodeTable::instance().intern(name.data(), name.size()))).first;
+        info = cached->second;
+    }
+    trace_line.opcode_id = info.id;
+    trace_line.is_roi_begin = (info.id == OpcodeTable::ROI_BEGIN);
+    trace_line.is_roi_end = (info.id == OpcodeTable::ROI_END);
+    trace_line.cycle_cost = info.cycles;
+    return true;
+}
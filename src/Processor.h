@@ -2,6 +2,7 @@
 #define __PROCESSOR_H
 
 #include "Cache.h"
+#include "Checkpoint.h"
 #include "Config.h"
 #include "Memory.h"
 #include "Request.h"
@@ -22,10 +23,16 @@
 #include <cstdlib>
 #include <chrono>
 #include <thread>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <map>
 #include <cmath>
 
 #include "../Trace_Extractor/trace_format.h"
+#include "../Trace_Extractor/trace_codec.h"
+#include "../Trace_Extractor/trace_container.h"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -42,9 +49,68 @@ struct BasicBlockInfo {
     int TotalMemoryConsumption;
 };
 
+/* trace record as the cores consume it, the opcode is resolved once when the record is read */
+struct trace_instruction : public trace_format
+{
+    int opcode_id = -1;         // dense opcode id (see OpcodeTable).
+    bool is_roi_begin = false;
+    bool is_roi_end = false;
+    int cycle_cost = 0;         // execution cycles of the opcode (x86_opcode_cycles.csv), 0 when unknown.
+
+    bool is_roi_marker() const { return is_roi_begin || is_roi_end; }
+};
+
+/* dense ids of the opcodes of every trace, ROI markers have fixed ids */
+class OpcodeTable {
+public:
+    static const int ROI_BEGIN = 0;
+    static const int ROI_END = 1;
+
+    struct Info {
+        int id;
+        int cycles;
+    };
+
+    static OpcodeTable& instance();
+    void load_cycles(const string& path);       // once, before any trace is read.
+    Info intern(const char* opcode, size_t length);
+
+private:
+    OpcodeTable();
+    std::mutex lock;                            // traces may be decoded off the simulation thread.
+    bool cycles_loaded = false;
+    std::unordered_map<std::string, int> cycle_db;
+    std::unordered_map<std::string, int> ids;
+};
+
+/* slab of the decoded instructions queued for the cores of one side, addressed by compact handles. The slab grows by
+   blocks that never move, so a slot stays where it is until it is released: the producer decodes or copies into it and
+   the consumer executes from it. Only its side's thread (or the quantum boundary) touches it, it takes no lock. */
+class InstructionPool {
+public:
+    typedef uint32_t Handle;
+    static const Handle NONE = ~Handle(0);
+
+    Handle allocate();                          // a free slot, its contents are left to the caller.
+    trace_instruction& at(Handle handle) { return blocks[handle >> BLOCK_BITS][handle & (BLOCK_SLOTS - 1)]; }
+    void release(Handle handle) { free_handles.push_back(handle); }
+
+private:
+    static const int BLOCK_BITS = 8;
+    static const Handle BLOCK_SLOTS = 1 << BLOCK_BITS;
+    std::vector<std::unique_ptr<trace_instruction[]>> blocks;
+    std::vector<Handle> free_handles;
+    Handle allocated = 0;
+};
+
+/* ring of instruction handles queued for a core, credit_limit bounds it (0 = unbounded, the ring grows) */
 struct SqueduleQueue{
-    deque<trace_format> trace_queue;
+    InstructionPool* pool = nullptr;        // the pool of the core's side.
+    std::vector<InstructionPool::Handle> handles;
+    size_t head = 0;
     int numberInstructionsInQueue = 0;
+    int credit_limit = 0;                   // mcp_core_queue_max_size for the MCP PUs.
+    int seen_length = 0;                    // the length another side sees while the sides run apart (quantum engine).
 
     bool is_empty(){
         if (numberInstructionsInQueue == 0 )
@@ -52,27 +118,218 @@ struct SqueduleQueue{
         return false;
     }
 
-    void pop_front(){
-        if(!is_empty()){
-            trace_queue.pop_front();
-            numberInstructionsInQueue--;
+    bool has_credit() const { return credit_limit == 0 || numberInstructionsInQueue < credit_limit; }
+    bool has_seen_credit() const { return credit_limit == 0 || seen_length < credit_limit; }
+
+    // queue a new slot at the back and hand it out to be filled in place.
+    trace_instruction& push_back(){
+        if (size_t(numberInstructionsInQueue) == handles.size()){
+            // keep the ring a power of two, unwrapped into the new storage.
+            std::vector<InstructionPool::Handle> grown(max<size_t>(16, 2 * handles.size()));
+            for (int i = 0; i < numberInstructionsInQueue; i++)
+                grown[i] = handles[(head + i) & (handles.size() - 1)];
+            handles.swap(grown);
+            head = 0;
+        }
+        InstructionPool::Handle handle = pool->allocate();
+        handles[(head + numberInstructionsInQueue) & (handles.size() - 1)] = handle;
+        numberInstructionsInQueue++;
+        return pool->at(handle);
+    }
+
+    void push_back(const trace_instruction& line){
+        push_back() = line;
+    }
+
+    // unqueue the front slot, the caller owns it until it releases it to the pool.
+    InstructionPool::Handle pop_front(){
+        InstructionPool::Handle handle = handles[head];
+        head = (head + 1) & (handles.size() - 1);
+        numberInstructionsInQueue--;
+        return handle;
+    }
+
+    // the queued instructions in order, restored into fresh slots
+    void checkpoint(Checkpoint& cp){
+        while (cp.restoring && !is_empty())
+            pool->release(pop_front());
+        int count = numberInstructionsInQueue;
+        cp.io(count);
+        for (int i = 0; i < count; i++){
+            if (cp.restoring)
+                cp.io(push_back());
+            else
+                cp.io(pool->at(handles[(head + i) & (handles.size() - 1)]));
         }
     }
 };
 
+class Trace;
+
+/* fixed-size single-producer/single-consumer ring of decoded trace lines */
+class TraceRing {
+public:
+    explicit TraceRing(size_t entries);         // rounded up to a power of two.
+    bool full() const { return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == slots.size(); }
+    trace_instruction& next_slot() { return slots[tail.load(std::memory_order_relaxed) & mask]; }
+    void publish() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    bool pop(trace_instruction& line);          // false when empty.
+    std::atomic<bool> ended;                    // set by the producer after the last line is published.
+
+private:
+    std::vector<trace_instruction> slots;
+    size_t mask;
+    std::atomic<size_t> head, tail;
+};
+
+/* worker threads decoding traces ahead of the cores into their rings (trace_decode_workers) */
+class TraceDecodePool {
+public:
+    static TraceDecodePool& instance();
+    ~TraceDecodePool();
+    void attach(Trace* trace, int workers);
+    void detach(Trace* trace);                  // the trace is not touched by any worker once this returns.
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex lock;                        // held while the worker fills the rings of its traces.
+        std::vector<Trace*> traces;
+    };
+    std::mutex lock;
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t next_worker = 0;
+    std::atomic<bool> stopping;
+
+    TraceDecodePool() : stopping(false) {}
+    void run(Worker* worker);
+};
+
+/*
+ * decoded lines of a trace file shared by the simulators of a sweep (--sweep): the file is read and decoded once, by
+ * whichever reader gets ahead first. The lines are kept in linked blocks, a block is freed once every reader has
+ * passed it, so the spread between the fastest and the slowest simulator bounds the memory.
+ */
+class SharedTraceStream {
+public:
+    struct Block {
+        std::vector<trace_instruction> lines;
+        std::shared_ptr<Block> next;
+    };
+
+    static void enable();                       // the traces opened from now on are shared (before the simulators start).
+    static void release_starts();               // every reader has opened its trace, the first blocks may go.
+    static std::shared_ptr<SharedTraceStream> attach(const string& trace_fname, const Config& configs);
+
+    std::shared_ptr<Block> start() const { return first; }
+    bool next(std::shared_ptr<Block>& block, size_t& pos, trace_instruction& line);
+    const Trace& source() const { return *reader; }
+
+private:
+    static const size_t BLOCK_LINES = 4096;
+    std::mutex lock;
+    std::unique_ptr<Trace> reader;              // decodes the file, only under lock.
+    std::shared_ptr<Block> first;               // empty block ahead of the file, held until release_starts().
+    bool ended = false;
+};
+
 class Trace {
 public:
     Trace() {}
     Trace(const string& trace_fname);
+    Trace(const Trace&) = delete;               // owns the file handle/mapping, never copied.
+    Trace& operator=(const Trace&) = delete;
+    ~Trace();
     bool init_trace(const string& trace_fname, const Config &configs);
-    bool get_trace_line(trace_format& trace_line);
+    bool get_trace_line(trace_instruction& trace_line);
+    bool decode_line(trace_instruction& trace_line);   // read and classify the next line (on the decode worker when there is a ring).
+    bool fill_ring();                           // decode into the ring until it is full, false when nothing was added.
+    const trace_format* next_trace_line();      // hand out the next record by pointer (nullptr at the end of trace).
+    void checkpoint(Checkpoint& cp);            // the position of the core in the trace.
+    void settle();                              // wait for the chunks being inflated (before a fork).
     long expected_limit_insts = 0;
     Config configs;
+    trace_summary summary;                      // counts written by the tracer/converter when the trace was closed.
+    bool has_summary = false;
     
 private:
-    FILE* file;
+    friend class SharedTraceStream;
+    FILE* file = NULL;                          // stream backend, used for pipes or when trace_reader = stream.
     std::string trace_name;
     std::vector<int> instructions;
+
+    uint16_t format_version = TRACE_FORMAT_V1;  // v1 (raw trace_format records) or v2 (compact, see trace_codec.h).
+    trace_codec::Decoder decoder;               // v2 record decoder.
+    trace_format decoded_line;                  // record handed out when it can not point into the input.
+    long decoded_opcode = -1;                   // decoder dictionary index of the last record, -1 for v1 (resolved by name).
+    std::vector<OpcodeTable::Info> opcode_cache;    // decoder dictionary index -> opcode info.
+    std::unordered_map<std::string, OpcodeTable::Info> opcode_names;    // v1 opcode name -> opcode info.
+
+    const char* mapped = nullptr;               // mmap backend, used for regular trace files.
+    size_t mapped_size = 0;                     // mapped length.
+    size_t read_offset = 0;                     // offset of the next record in the mapping.
+    size_t readahead_window = 0;                // bytes prefetched ahead of read_offset.
+    size_t readahead_offset = 0;                // end of the region already advised as WILLNEED.
+    size_t released_offset = 0;                 // start of the region not yet dropped behind read_offset.
+    size_t advise_offset = 0;                   // read_offset at which the read-ahead window is topped up again.
+    std::vector<char> stream_buffer;            // input buffer of the stream backend.
+    size_t stream_pos = 0, stream_end = 0;      // unread bytes of stream_buffer.
+    uint64_t records_read = 0;                  // records handed out (progress report against summary).
+    uint64_t progress_step = 0, next_progress = 0;  // 0 without a summary (no progress report).
+    std::unique_ptr<TraceRing> ring;            // decoded lines ahead of the core (trace_decode_workers > 0).
+    bool replay_line = false;                   // hand out decoded_line again (set after seeking to a ROI marker).
+    bool shareable = true;                      // false for the reader of a shared stream.
+    std::shared_ptr<SharedTraceStream> shared;  // the lines come from a stream shared with other simulators (sweep).
+    std::shared_ptr<SharedTraceStream::Block> shared_block;
+    size_t shared_pos = 0;
+
+    trace_codec::ContainerIndex chunk_index;    // v3 footer index.
+    size_t next_chunk = 0;                      // next chunk to hand to the decode pipeline.
+    unsigned decode_threads = 1;                // chunks inflated ahead in parallel.
+    std::deque<std::future<std::vector<uint8_t>>> inflight_chunks;
+    std::vector<uint8_t> chunk_data;            // v2 records of the current chunk.
+    size_t chunk_pos = 0;
+
+    bool map_trace(int fd);
+    void advance_readahead();
+    size_t available(size_t need);              // readable bytes at the cursor, refilling the stream buffer below need.
+    const char* cursor() const;
+    void consume(size_t bytes);
+    bool seek_start(const Config &configs);     // skip to trace_start_inst or to an instance of trace_start_region.
+    void skip_progress(uint64_t records);       // records skipped before the simulation start count as read.
+    bool seek_record(uint64_t record);          // continue from a record of the file (restored checkpoint).
+    void schedule_chunks();
+    bool load_next_chunk();
+};
+
+/*
+ * sampled simulation of repeated ROI instances (sample_period > 0): the first sample_first_instances instances of a
+ * region and then every sample_period-th one run in detail, the others are fast-forwarded. The cost of the skipped
+ * instances is estimated per region from the measured ones, with a 95% confidence interval from their spread. The
+ * cycles, the memory traffic and the energy of a sample are taken per instruction executed during it by all cores
+ * and processing units: they run in parallel, so their work overlaps the sample.
+ */
+struct RegionSampler {
+    enum Metric { CYCLES, BYTES, ENERGY, MAX };
+    struct Region {
+        long instances = 0;                 // instances met after the warmup.
+        long skipped = 0, skipped_insts = 0;
+        long samples = 0;                   // measured detailed instances.
+        double insts = 0, value[MAX] = {};
+        double ratio[MAX] = {};             // sums of the per-instance values per instruction,
+        double ratio_sq[MAX] = {};          // and of their squares.
+    };
+    long first = 2;
+    long period = 0;
+    long skipped_insts = 0;                 // instructions of all skipped instances (they count to the limit).
+    std::map<long, Region> regions;
+
+    bool enabled() const { return period > 0; }
+    bool detailed(long region);                         // counts the instance, false when it is fast-forwarded.
+    void skipped(long region, long insts);
+    void measured(long region, long core_insts, long all_insts, long cycles, double bytes, double energy);
+    // the estimate for all skipped instances: first the value, second the half width of its 95% interval.
+    std::pair<double, double> estimate(Metric metric) const;
 };
 
 class Window {
@@ -92,6 +349,7 @@ public:
     long retire();
     void set_ready(long addr, int mask);
     void reset_window();
+    void checkpoint(Checkpoint& cp);
 };
 
 class Processor;
@@ -124,6 +382,7 @@ public:
     int l2_mshr_num = 16;
 
     long bubble_cnt;                        // from trace line this information extracted for execution phase.
+    long inst_pc = 0;                       // instruction pointer of the trace line, the PC of its loads and stores.
     long req_addr = -1;
     Request::Type req_type;
     long region_id = 0;
@@ -135,6 +394,7 @@ public:
     bool inside_region = false;             // indicate that control inside the offloadbale region.
     bool is_warmup_done = true;             // indicate that the warmup stage.
     bool pending_inst_bypass = false;       // used to specify that still there instruction pending to bypass on NMP side.
+    Core* bypass_target = nullptr;          // the MCP PU the pending instruction waits for a credit of.
     bool wait_for_nmp_finish = false;       // used to notify the CPU cores to wait from NMP side execution finish.
     int decision_overhead_cycles = 0;       // carry the decisio-making overhead cycle count.
     float active_core_energy;               // contain core's active cycle energy consumption.
@@ -143,16 +403,28 @@ public:
     int l_index, s_index;                   // used in loop.
     int deployed_app_id, current_thread_id; // contain the process and thread ID w.r.t. core.
     bool trace_assigned = false;            // specify that the core contain the master thread.
+    bool per_thread_trace = false;          // the core's trace holds its own thread only (trace_input = per_thread).
     int own_vault_target_addr = -1;         // initially core are not assign to NMP side.
     bool proc_switching_flag = false;       // used in context switching to specify the CPU side can switch to NMP side.
     long nlp_core_id_gen = 0;               // used to generate core ID for NLP side.
     bool nlp_side = false;                  // used to specify the core belong to NLP side.
     bool loads_exe_flag, stores_exe_flag;   // these are simple excution tracking flags.
+    bool sleeping = false;                  // an idle in-order core is left out of the processor tick (see Processor::tick).
+    long slept_at = 0;                      // processor cycle of the first tick skipped while sleeping.
+    long fast_forwarded = 0;                // instructions executed functionally (fast-forward, skipped ROI instances).
+    bool skipping = false;                  // a skipped ROI instance is being fast-forwarded.
+    long sample_region = -1;                // region of the detailed instance being measured (-1 none).
+    bool sample_closing = false;            // its ROI_END was read, the sample closes at the next executed instruction.
+    long sample_clk = 0, sample_insts = 0;  // clock and instructions of the sample (own ones counted, all sides
+    long sample_all_insts = 0;              // taken at the start),
+    double sample_bytes = 0;                // and memory traffic and energy at the start of the sample.
+    double sample_energy = 0;
 
-    std::unordered_map<std::string, int> opcodeCycleCount;  // this will store the info of which opcode consume how many cycle.
     set<long> offload_region_ids;                           // track the offloading region IDs.
     std::shared_ptr<CacheSystem> cachesys;                  // cache system pointer.
-    trace_format trace_line;                                // storing one instruction info which fetched from trace file.
+    trace_instruction own_line;                             // storing one instruction info which fetched from trace file.
+    trace_instruction* trace_line = &own_line;              // the instruction executed: own_line or a slot of the pool.
+    InstructionPool::Handle held = InstructionPool::NONE;   // that slot, released when the next instruction is taken.
     SqueduleQueue inst_queue;                               // store the offloaded instruction.
     json bb_info_data;                                      // contain compiler-extracted info.
     function<bool(Request)> send;                           // by this function memory request will traverse from core to memory.
@@ -196,6 +468,7 @@ public:
     int get_vault_target(long mem_addr);
     void lock_own_cores(long app_id, bool flag);
     bool get_next_instruction();
+    void take_queued();
     void execution_flag_set();
     void memory_allocates();
     void offload_stratigy();
@@ -205,6 +478,19 @@ public:
     void reset_stats();
     long get_executed_insts();
     void instruction_bypass();
+    void offload_pending();
+    bool can_take_offload(const Processor* from);
+    void take_offload(const Processor* from, const trace_instruction& line);
+    bool can_sleep();
+    void sleep();
+    void wake();
+    bool drained();
+    void checkpoint(Checkpoint& cp);
+    bool fast_forward(bool warm = true);
+    void skip_region();
+    void close_sample();
+    long system_insts();                    // instructions executed by the host, NMP and NLP sides (host's view).
+    bool offload_decision(int regionID);    // whether the region starting at this ROI_BEGIN is offloaded.
 };
 
 class Processor {
@@ -217,6 +503,7 @@ public:
     
     int initial_core_id;            // used to specify the starting ID of containing cores.
     int number_cores;               // specify how many cores the processor has.
+    int participating_cores = 0;    // cores the trace hands a thread to (from its summary), 0 when unknown.
     double ipc = 0;                 // instruction-per-sec.
     long total_retired = 0;         // store the total no of retired instructions.
     long total_instructions = 0;    // store total no of executed instruction.
@@ -231,8 +518,33 @@ public:
     int l3_assoc = 1 << 5;
     int l3_blocksz = 1 << 6;
     int mshr_per_bank = 16;
+    unsigned int ticking_core = 0;  // index of the core being ticked (cores.size() once the tick is done).
+    bool draining = false;          // before a checkpoint: the cores issue nothing until every access has completed.
+    RegionSampler sampler;          // sampled simulation of repeated ROI instances (host side).
+
+    // Oracle mode: each ROI instance is run both ways in forked branches (child processes), the faster choice is kept.
+    // A branch runs until the instance has retired on its core and reports the cycles and the instructions of all
+    // sides on oracle_fd.
+    int oracle_fd = -1;                         // >= 0 in a branch.
+    Core* oracle_core = nullptr;                // the core and the region instance evaluated by the branch,
+    long oracle_region = -1;
+    long oracle_clk = 0;                        // its clock and the instructions of all sides at the ROI_BEGIN,
+    long oracle_insts = 0;
+    bool oracle_closing = false;                // the ROI_END was read,
+    long oracle_retire_target = -1;             // and the instructions to retire once the core runs on after it.
+    std::map<long, bool> oracle_choices;        // last choice per region, taken inside a branch.
+    std::ofstream oracle_log;
+
+    // quantum engine: a detached side runs on its own thread. The other sides only see the state it published at
+    // the last quantum boundary, and their actions on it wait in its inbox until the next boundary.
+    bool detached = false;
+    vector<function<void()>> inbox;
+    float published_insts = 0;
+    bool published_context_switch = false;
+    bool published_nmp_switch = false;
 
     std::shared_ptr<CacheSystem> cachesys;
+    InstructionPool pool;                           // the instructions queued for the cores of this processor.
     std::vector<std::unique_ptr<Core>> cores;       // contain all the pointer of corrosponding cores.
     std::vector<double> ipcs;                       // carry individual IPC of corrospondingg cores.
 
@@ -254,6 +566,21 @@ public:
     ScalarStat total_time;
     ScalarStat total_overhead_cycles;
     ScalarStat total_energy_consumption;
+    ScalarStat sampled_region_instances;    // sampled simulation, only printed when it skipped something.
+    ScalarStat skipped_region_instances;
+    ScalarStat skipped_region_instructions;
+    ScalarStat extrapolated_cycles;
+    ScalarStat extrapolated_cycles_ci95;
+    ScalarStat extrapolated_time;
+    ScalarStat extrapolated_memory_bytes;
+    ScalarStat extrapolated_memory_bytes_ci95;
+    ScalarStat extrapolated_energy;
+    ScalarStat extrapolated_energy_ci95;
+    ScalarStat oracle_host_regions;         // Oracle mode.
+    ScalarStat oracle_offloaded_regions;
+    ScalarStat oracle_host_cycles;
+    ScalarStat oracle_offload_cycles;
+    ScalarStat oracle_best_cycles;
     
     void tick();                    // function defination will be specified in cpp file.
     void receive(Request& req);
@@ -263,16 +590,34 @@ public:
     void init_nmp_side();
     void init_nlp_side();
     void lock_all_cores(bool flag);
+    void check_trace_summaries();
     void reset_stats();
     long get_executed_insts();
     void warmedup_activate();
     float calculate_total_instruction();
     float calculate_Energy();
     bool is_complete();
-    bool can_context_switch(long processID);
+    bool can_context_switch(long processID, bool restore_tags = true);
     bool can_nmp_switch();
     std::vector<float> collect_system_info();  
     void flush_all_caches();
+    void wake_all_cores();
+    bool across(const Processor* from) const { return detached != from->detached; }
+    void post(const Processor* from, function<void()> action);
+    void apply_inbox();
+    void publish();
+    float seen_total_instruction(const Processor* from);
+    bool seen_context_switch(const Processor* from, long processID);
+    bool seen_nmp_switch(const Processor* from);
+    bool drained();
+    void checkpoint(Checkpoint& cp);
+    long fast_forward(long insts, long region, long instance);
+    void init_sampling_stats(const string& prefix);
+    void calc_sampling_stats();
+    void init_oracle_stats(const string& prefix);
+    bool oracle_decide(Core* core, long region);
+    void oracle_check(Core* core);
+    void oracle_report();
 };
 
 }
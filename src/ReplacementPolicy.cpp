@@ -0,0 +1,309 @@
+#include "ReplacementPolicy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace ramulator
+{
+
+const unsigned short LruPolicy::EMPTY_AGE;
+const unsigned char RripPolicy::DISTANT;
+const unsigned char RripPolicy::EMPTY;
+const int DrripPolicy::PSEL_MAX;
+const int ShipPolicy::SHCT_ENTRIES;
+const unsigned char ShipPolicy::SHCT_MAX;
+
+/* the policy of a cache level by its configured name */
+ReplacementPolicy* ReplacementPolicy::create(const string& name, const string& level, int sets, int assoc)
+{
+    if (name == "lru")
+        return new LruPolicy(level, sets, assoc);
+    if (name == "random")
+        return new RandomPolicy(level, sets, assoc);
+    if (name == "srrip")
+        return new SrripPolicy(level, sets, assoc);
+    if (name == "drrip")
+        return new DrripPolicy(level, sets, assoc);
+    if (name == "ship")
+        return new ShipPolicy(level, sets, assoc);
+    printf("Unknown replacement policy \"%s\" for the %s caches (lru, random, srrip, drrip or ship).\n",
+           name.c_str(), level.c_str());
+    exit(1);
+}
+
+ReplacementPolicy::ReplacementPolicy(const string& name, const string& level, int sets, int assoc)
+    : name(name), sets(sets), assoc(assoc), reused(long(sets) * assoc, false)
+{
+    order.reserve(assoc);
+    dead_evictions.name(level + "_" + name + "_dead_evictions")
+        .desc("lines evicted without a hit since they were filled")
+        .precision(0);
+}
+
+void ReplacementPolicy::filled(int set, int way, long addr)
+{
+    reused[slot(set, way)] = false;
+    on_fill(set, way, addr);
+}
+
+void ReplacementPolicy::touched(int set, int way)
+{
+    on_hit(set, way);
+    reused[slot(set, way)] = true;
+}
+
+void ReplacementPolicy::written_back(int set, int way)
+{
+    on_write_back(set, way);
+}
+
+void ReplacementPolicy::evicted(int set, int way)
+{
+    if (!reused[slot(set, way)])
+        count(dead_evictions);
+    on_evict(set, way);
+}
+
+void ReplacementPolicy::removed(int set, int way)
+{
+    on_remove(set, way);
+}
+
+void ReplacementPolicy::checkpoint_line(Checkpoint& cp, int set, int way)
+{
+    bool hit = reused[slot(set, way)];
+    cp.io(hit);
+    reused[slot(set, way)] = hit;
+    checkpoint_state(cp, slot(set, way));
+}
+
+LruPolicy::LruPolicy(const string& level, int sets, int assoc)
+    : ReplacementPolicy("lru", level, sets, assoc), ages(long(sets) * assoc, EMPTY_AGE)
+{
+    assert(assoc < EMPTY_AGE);
+}
+
+/* the new line gets the age 0, every other line of the set gets one older. Every way is updated without a branch
+   (a free way never counts as older), so the loop vectorizes. */
+void LruPolicy::on_fill(int set, int way, long addr)
+{
+    unsigned short* set_ages = &ages[slot(set, 0)];
+    unsigned short size = 0;
+    for (int other = 0; other < assoc; other++)
+        size += (set_ages[other] != EMPTY_AGE);
+    for (int other = 0; other < assoc; other++)
+        set_ages[other] += (set_ages[other] < size);
+    set_ages[way] = 0;
+}
+
+/* the lines used after this one get one older, this one gets the age 0 */
+void LruPolicy::on_hit(int set, int way)
+{
+    unsigned short* set_ages = &ages[slot(set, 0)];
+    unsigned short age = set_ages[way];
+    for (int other = 0; other < assoc; other++)
+        set_ages[other] += (set_ages[other] < age);
+    set_ages[way] = 0;
+}
+
+/* the lines used before this one get one younger */
+void LruPolicy::on_remove(int set, int way)
+{
+    unsigned short* set_ages = &ages[slot(set, 0)];
+    unsigned short age = set_ages[way];
+    set_ages[way] = EMPTY_AGE;
+    for (int other = 0; other < assoc; other++)
+        set_ages[other] -= (set_ages[other] > age && set_ages[other] != EMPTY_AGE);
+}
+
+/* the ages of a set are distinct, the line of age a is the (a+1)-th most recently used */
+const vector<int>& LruPolicy::victims(int set)
+{
+    const unsigned short* set_ages = &ages[slot(set, 0)];
+    int size = 0;
+    for (int way = 0; way < assoc; way++)
+        size += (set_ages[way] != EMPTY_AGE);
+    order.resize(size);
+    for (int way = 0; way < assoc; way++)
+        if (set_ages[way] != EMPTY_AGE)
+            order[size - 1 - set_ages[way]] = way;
+    return order;
+}
+
+RandomPolicy::RandomPolicy(const string& level, int sets, int assoc)
+    : ReplacementPolicy("random", level, sets, assoc), valid(long(sets) * assoc, false)
+{
+}
+
+/* the lines from a random way on, wrapping around the set (xorshift64*, reproducible from run to run) */
+const vector<int>& RandomPolicy::victims(int set)
+{
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    int start = int(((rand_state * 0x2545f4914f6cdd1dul) >> 32) % assoc);
+    order.clear();
+    for (int i = 0; i < assoc; i++) {
+        int way = (start + i) % assoc;
+        if (valid[slot(set, way)])
+            order.push_back(way);
+    }
+    return order;
+}
+
+void RandomPolicy::checkpoint(Checkpoint& cp)
+{
+    cp.io(rand_state);
+}
+
+RripPolicy::RripPolicy(const string& name, const string& level, int sets, int assoc)
+    : ReplacementPolicy(name, level, sets, assoc), rrpv(long(sets) * assoc, EMPTY)
+{
+    distant_inserts.name(level + "_" + name + "_distant_inserts")
+        .desc("lines inserted with the distant re-reference prediction")
+        .precision(0);
+}
+
+/* the lines with the largest prediction first, the lowest way first among equal ones */
+const vector<int>& RripPolicy::victims(int set)
+{
+    const unsigned char* values = &rrpv[slot(set, 0)];
+    order.clear();
+    for (int value = DISTANT; value >= 0; value--)
+        for (int way = 0; way < assoc; way++)
+            if (values[way] == value)
+                order.push_back(way);
+    return order;
+}
+
+void RripPolicy::on_fill(int set, int way, long addr)
+{
+    unsigned char value = insertion(set, way, addr);
+    if (value == DISTANT)
+        count(distant_inserts);
+    rrpv[slot(set, way)] = value;
+}
+
+void RripPolicy::on_hit(int set, int way)
+{
+    rrpv[slot(set, way)] = 0;
+}
+
+/* the set ages until the victim would have had the distant prediction: the others get older by as much */
+void RripPolicy::on_evict(int set, int way)
+{
+    unsigned char* values = &rrpv[slot(set, 0)];
+    unsigned char aging = DISTANT - values[way];
+    for (int other = 0; other < assoc; other++)
+        if (values[other] != EMPTY)
+            values[other] = min<unsigned char>(DISTANT, values[other] + aging);
+}
+
+void RripPolicy::on_remove(int set, int way)
+{
+    rrpv[slot(set, way)] = EMPTY;
+}
+
+void RripPolicy::checkpoint_state(Checkpoint& cp, long slot)
+{
+    cp.io(rrpv[slot]);
+}
+
+DrripPolicy::DrripPolicy(const string& level, int sets, int assoc)
+    : RripPolicy("drrip", level, sets, assoc), constituency(max(2, sets / 32))
+{
+    srrip_leader_misses.name(level + "_drrip_srrip_leader_misses")
+        .desc("fills of the SRRIP leader sets")
+        .precision(0);
+    brrip_leader_misses.name(level + "_drrip_brrip_leader_misses")
+        .desc("fills of the BRRIP leader sets")
+        .precision(0);
+    brrip_follower_inserts.name(level + "_drrip_brrip_follower_inserts")
+        .desc("fills of the follower sets inserted as BRRIP")
+        .precision(0);
+    final_psel.name(level + "_drrip_psel")
+        .desc("policy selector at the end (0 to 1023, above 511 the followers insert as BRRIP)")
+        .precision(0);
+    final_psel = psel;
+}
+
+/* every fill is a miss: a miss in a leader set votes for the other policy */
+unsigned char DrripPolicy::insertion(int set, int way, long addr)
+{
+    bool brrip;
+    if (set % constituency == 0) {
+        count(srrip_leader_misses);
+        psel = min(PSEL_MAX, psel + 1);
+        brrip = false;
+    } else if (set % constituency == constituency / 2) {
+        count(brrip_leader_misses);
+        psel = max(0, psel - 1);
+        brrip = true;
+    } else {
+        brrip = (psel > PSEL_MAX / 2);
+        if (brrip)
+            count(brrip_follower_inserts);
+    }
+    if (counting)
+        final_psel = psel;
+    if (!brrip)
+        return DISTANT - 1;
+    return (bimodal_inserts++ % 32 == 0) ? DISTANT - 1 : DISTANT;
+}
+
+void DrripPolicy::checkpoint(Checkpoint& cp)
+{
+    cp.io(psel);
+    cp.io(bimodal_inserts);
+}
+
+ShipPolicy::ShipPolicy(const string& level, int sets, int assoc)
+    : RripPolicy("ship", level, sets, assoc), shct(SHCT_ENTRIES, 1), signatures(long(sets) * assoc, 0)
+{
+    reused_lines.name(level + "_ship_reused_lines")
+        .desc("lines hit at least once since they were filled")
+        .precision(0);
+}
+
+/* the line takes the signature of its region, the region predicts its reuse */
+unsigned char ShipPolicy::insertion(int set, int way, long addr)
+{
+    long region = addr >> 14;
+    unsigned short signature = (region ^ (region >> 14) ^ (region >> 28)) & (SHCT_ENTRIES - 1);
+    signatures[slot(set, way)] = signature;
+    return (shct[signature] == 0) ? DISTANT : DISTANT - 1;
+}
+
+void ShipPolicy::on_hit(int set, int way)
+{
+    unsigned char& counter = shct[signatures[slot(set, way)]];
+    counter = min(SHCT_MAX, (unsigned char)(counter + 1));
+    if (!reused[slot(set, way)])
+        count(reused_lines);
+    RripPolicy::on_hit(set, way);
+}
+
+void ShipPolicy::on_evict(int set, int way)
+{
+    unsigned char& counter = shct[signatures[slot(set, way)]];
+    if (!reused[slot(set, way)] && counter > 0)
+        counter--;
+    RripPolicy::on_evict(set, way);
+}
+
+void ShipPolicy::checkpoint_state(Checkpoint& cp, long slot)
+{
+    RripPolicy::checkpoint_state(cp, slot);
+    cp.io(signatures[slot]);
+}
+
+void ShipPolicy::checkpoint(Checkpoint& cp)
+{
+    cp.io(shct);
+}
+
+} /* namespace ramulator */
@@ -0,0 +1,179 @@
+#ifndef __REPLACEMENT_POLICY_H
+#define __REPLACEMENT_POLICY_H
+
+#include "Checkpoint.h"
+#include "Statistics.h"
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+/*
+ * replacement state of one set-associative cache (l1_replacement, l2_replacement, llc_replacement and
+ * mcp_l1_replacement: lru, random, srrip, drrip or ship). The cache tells the policy which ways are filled, hit and
+ * emptied, and asks it for the order to try the victims of a set in: the first line of that order no request holds
+ * locked is evicted.
+ */
+class ReplacementPolicy
+{
+public:
+    static ReplacementPolicy* create(const std::string& name, const std::string& level, int sets, int assoc);
+    virtual ~ReplacementPolicy() {}
+
+    const std::string name;
+    bool counting = true;   // off for the functional accesses of the fast-forward, the stats count the detailed parts
+
+    void filled(int set, int way, long addr);   // a line was put in the free way
+    void touched(int set, int way);             // the line was hit
+    void written_back(int set, int way);        // a higher level evicted its copy of the line, not a reuse
+    void evicted(int set, int way);             // the line was taken as the victim, removed() follows
+    void removed(int set, int way);             // the line left the way (victim or invalidation)
+
+    // the ways of the set holding a line, the preferred victim first (valid until the next call)
+    virtual const std::vector<int>& victims(int set) = 0;
+
+    // the state of a line, saved after it and restored after filled() put it back (the lines of a set are saved in
+    // the order of victims()), then the state of the whole cache.
+    void checkpoint_line(Checkpoint& cp, int set, int way);
+    virtual void checkpoint(Checkpoint& cp) {}
+
+protected:
+    ReplacementPolicy(const std::string& name, const std::string& level, int sets, int assoc);
+
+    int sets;
+    int assoc;
+    std::vector<unsigned char> reused;  // per way, hit since it was filled
+    std::vector<int> order;             // filled by victims()
+
+    ScalarStat dead_evictions;          // victims never hit since they were filled
+
+    long slot(int set, int way) const { return long(set) * assoc + way; }
+    void count(ScalarStat& stat) { if (counting) stat++; }
+
+    virtual void on_fill(int set, int way, long addr) = 0;
+    virtual void on_hit(int set, int way) = 0;
+    virtual void on_write_back(int set, int way) {}
+    virtual void on_evict(int set, int way) {}
+    virtual void on_remove(int set, int way) = 0;
+    virtual void checkpoint_state(Checkpoint& cp, long slot) {}
+};
+
+// least recently used: ages are distinct ranks within a set, 0 for the most recently used line.
+class LruPolicy : public ReplacementPolicy
+{
+public:
+    LruPolicy(const std::string& level, int sets, int assoc);
+    const std::vector<int>& victims(int set);
+
+protected:
+    static const unsigned short EMPTY_AGE = 0xffff;
+    std::vector<unsigned short> ages;
+
+    void on_fill(int set, int way, long addr);
+    void on_hit(int set, int way);
+    void on_write_back(int set, int way) { on_hit(set, way); }  // the line becomes the most recently used one too
+    void on_remove(int set, int way);
+};
+
+// a random line: the victims start at a random way of the set.
+class RandomPolicy : public ReplacementPolicy
+{
+public:
+    RandomPolicy(const std::string& level, int sets, int assoc);
+    const std::vector<int>& victims(int set);
+    void checkpoint(Checkpoint& cp);
+
+protected:
+    std::vector<unsigned char> valid;
+    unsigned long rand_state = 0x9e3779b97f4a7c15ul;
+
+    void on_fill(int set, int way, long addr) { valid[slot(set, way)] = true; }
+    void on_hit(int set, int way) {}
+    void on_remove(int set, int way) { valid[slot(set, way)] = false; }
+};
+
+// re-reference interval prediction (Jaleel et al., ISCA 2010) with 2-bit prediction values: the victims are the
+// lines predicted to be re-referenced last, a hit predicts a near re-reference and a write-back from above leaves
+// the prediction as it is. The policies differ by the value a new line is inserted with.
+class RripPolicy : public ReplacementPolicy
+{
+public:
+    const std::vector<int>& victims(int set);
+
+protected:
+    static const unsigned char DISTANT = 3;     // the largest prediction value
+    static const unsigned char EMPTY = 0xff;
+    std::vector<unsigned char> rrpv;
+
+    ScalarStat distant_inserts;                 // lines inserted with the distant prediction
+
+    RripPolicy(const std::string& name, const std::string& level, int sets, int assoc);
+    virtual unsigned char insertion(int set, int way, long addr) = 0;
+
+    void on_fill(int set, int way, long addr);
+    void on_hit(int set, int way);
+    void on_evict(int set, int way);
+    void on_remove(int set, int way);
+    void checkpoint_state(Checkpoint& cp, long slot);
+};
+
+// static RRIP: every line is inserted with a long re-reference prediction.
+class SrripPolicy : public RripPolicy
+{
+public:
+    SrripPolicy(const std::string& level, int sets, int assoc) : RripPolicy("srrip", level, sets, assoc) {}
+
+protected:
+    unsigned char insertion(int set, int way, long addr) { return DISTANT - 1; }
+};
+
+// dynamic RRIP: 32 leader sets insert as SRRIP, 32 as bimodal RRIP (distant but for one line in 32), and the other
+// sets follow the leaders that miss less.
+class DrripPolicy : public RripPolicy
+{
+public:
+    DrripPolicy(const std::string& level, int sets, int assoc);
+    void checkpoint(Checkpoint& cp);
+
+protected:
+    static const int PSEL_MAX = 1023;           // 10-bit selector, above the middle the followers insert as BRRIP
+    int constituency;                           // sets per leader pair
+    int psel = (PSEL_MAX + 1) / 2;
+    long bimodal_inserts = 0;
+
+    ScalarStat srrip_leader_misses;
+    ScalarStat brrip_leader_misses;
+    ScalarStat brrip_follower_inserts;
+    ScalarStat final_psel;
+
+    unsigned char insertion(int set, int way, long addr);
+};
+
+// signature-based hit prediction (Wu et al., MICRO 2011) over RRIP. The signature is the 16KB memory region of the
+// line (SHiP-Mem) rather than the instruction pointer (SHiP-PC): write-backs and instruction fetches fill lines with
+// no Request::pc, every fill has an address. A region whose lines were evicted without a hit gets its lines inserted
+// with the distant prediction.
+class ShipPolicy : public RripPolicy
+{
+public:
+    ShipPolicy(const std::string& level, int sets, int assoc);
+    void checkpoint(Checkpoint& cp);
+
+protected:
+    static const int SHCT_ENTRIES = 1 << 14;
+    static const unsigned char SHCT_MAX = 7;    // 3-bit counters
+    std::vector<unsigned char> shct;            // hit counters by signature
+    std::vector<unsigned short> signatures;     // per way
+
+    ScalarStat reused_lines;                    // lines hit since they were filled
+
+    unsigned char insertion(int set, int way, long addr);
+    void on_hit(int set, int way);
+    void on_evict(int set, int way);
+    void checkpoint_state(Checkpoint& cp, long slot);
+};
+
+} /* namespace ramulator */
+
+#endif /* __REPLACEMENT_POLICY_H */
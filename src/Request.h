@@ -22,6 +22,8 @@ public:
     long initial_addr = 0;
     bool instruction_request = false;
     bool from_nmp = false;
+    bool prefetch = false;      // sent by the prefetcher of a cache, no instruction waits for it
+    long pc = 0;                // instruction pointer of the load or store, 0 when unknown
 
     enum class Type
     {
@@ -2,11 +2,11 @@
 #include <iostream>
 namespace Stats {
 
-// Statistics list
-StatList statlist;
+// Statistics list, one per simulation thread (a sweep runs several simulators in one process).
+thread_local StatList statlist;
 
 // The smallest timing granularity.
-Tick curTick = 0;
+thread_local Tick curTick = 0;
 
 void
 Histogram::grow_out()
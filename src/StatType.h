@@ -1,6 +1,7 @@
 #ifndef __STATTYPE_H
 #define __STATTYPE_H
 
+#include <algorithm>
 #include <limits>
 #include <fstream>
 #include <string>
@@ -73,6 +74,11 @@ class StatBase {
 
   virtual bool is_display() const  = 0;
   virtual bool is_nozero() const = 0;
+
+  // checkpointing: the values making up the statistic, empty when there is nothing to save
+  virtual const std::string& stat_name() const = 0;
+  virtual VCounter state() const { return VCounter(); }
+  virtual void set_state(const VCounter& values) {}
 };
 
 class StatList {
@@ -91,6 +97,9 @@ class StatList {
   void add(StatBase* stat) {
     list.push_back(stat);
   }
+  const std::vector<StatBase*>& all() const {
+    return list;
+  }
   void output(std::string filename) {
     stat_output.open(filename.c_str(), std::ios_base::out);
     if (!stat_output.good()) {
@@ -116,7 +125,7 @@ class StatList {
   }
 };
 
-extern StatList statlist;
+extern thread_local StatList statlist;    // stats register with the list of the thread building them.
 
 template<class Derived>
 class Stat : public StatBase {
@@ -163,6 +172,7 @@ class Stat : public StatBase {
   const std::string& setSeparator() const {return separatorString;}
 
   size_type size() const { return 0; }
+  const std::string& stat_name() const { return _name; }
 
   virtual void print(std::ofstream& file) {};
   virtual void printname(std::ofstream& file) {
@@ -261,10 +271,12 @@ class Scalar: public ScalarBase<Scalar> {
   virtual bool zero() const {return (fabs(_value) < eps);}
   void prepare() {}
   void reset() {_value = Counter();}
+  VCounter state() const {return VCounter(1, _value);}
+  void set_state(const VCounter& values) {_value = values[0];}
 
 };
 
-extern Tick curTick;
+extern thread_local Tick curTick;
 
 class Average: public ScalarBase<Average> {
  private:
@@ -311,6 +323,13 @@ class Average: public ScalarBase<Average> {
     last = curTick;
     lastReset = curTick;
   }
+  VCounter state() const {return {current, Counter(lastReset), total_val, Counter(last)};}
+  void set_state(const VCounter& values) {
+    current = values[0];
+    lastReset = Tick(values[1]);
+    total_val = values[2];
+    last = Tick(values[3]);
+  }
 
   Counter value() const { return current; }
   Result result() const {
@@ -392,6 +411,25 @@ class VectorBase: public Stat<Derived> {
       data[i].reset();
     }
   }
+  // the element count, then the state of every element (the elements are skipped on their own)
+  VCounter state() const {
+    VCounter values(1, Counter(size()));
+    for (off_type i = 0 ; i < size() ; ++i) {
+      VCounter element = data[i].state();
+      values.insert(values.end(), element.begin(), element.end());
+    }
+    return values;
+  }
+  void set_state(const VCounter& values) {
+    size_type saved = size_type(values[0]);
+    if (saved == 0) {
+      return;
+    }
+    size_type width = (values.size() - 1) / saved;
+    for (off_type i = 0 ; i < std::min(saved, size()) ; ++i) {
+      data[i].set_state(VCounter(values.begin() + 1 + i * width, values.begin() + 1 + (i + 1) * width));
+    }
+  }
   void print(std::ofstream& file) {
     Stat<Derived>::printname(file);
     file.precision(Stat<Derived>::_precision);
@@ -0,0 +1,85 @@
+#ifndef __TIMING_WHEEL_H
+#define __TIMING_WHEEL_H
+
+#include <cassert>
+#include <cstddef>
+#include <list>
+#include <vector>
+
+namespace ramulator
+{
+
+/*
+ * items waiting for the cycle they are due at: a ring of buckets, one per cycle. push() is O(1) whatever the order
+ * the cycles come in, expire() only looks at the buckets of the cycles that passed. The ring doubles when an item
+ * is due beyond it.
+ */
+template <typename T>
+class TimingWheel
+{
+public:
+    explicit TimingWheel(size_t cycles = 256) : buckets(cycles)
+    {
+        assert(cycles > 0 && (cycles & (cycles - 1)) == 0);
+    }
+
+    // an item due at a cycle that has expired already is due at the next expire()
+    void push(long cycle, const T& item)
+    {
+        if (cycle < next)
+            cycle = next;
+        while (cycle - next >= long(buckets.size()))
+            grow();
+        buckets[cycle & (buckets.size() - 1)].push_back(item);
+        count++;
+    }
+
+    // hand the items due by clk to take(), the earliest cycle first and in push order within a cycle. The ones it
+    // refuses (returns false) stay due, ahead of the others at the next call.
+    template <typename F>
+    void expire(long clk, F take)
+    {
+        for (auto it = refused.begin(); it != refused.end();)
+            it = take(*it) ? refused.erase(it) : ++it;
+
+        while (next <= clk && count > 0) {
+            due.swap(buckets[next & (buckets.size() - 1)]);
+            next++;
+            count -= due.size();
+            for (auto& item : due)
+                if (!take(item))
+                    refused.push_back(item);
+            due.clear();
+        }
+        if (next <= clk)
+            next = clk + 1;
+    }
+
+    // nothing is waiting (restore), the next expire() is at cycle
+    void restart(long cycle)
+    {
+        assert(empty());
+        next = cycle;
+    }
+
+    bool empty() const { return count == 0 && refused.empty(); }
+
+private:
+    std::vector<std::vector<T>> buckets;    // the items due at cycle c are in bucket c modulo the ring size
+    std::vector<T> due;                     // the bucket being expired
+    std::list<T> refused;                   // due, but not taken yet
+    long next = 0;                          // first cycle not expired yet, the buckets hold [next, next + size)
+    size_t count = 0;                       // items in the buckets
+
+    void grow()
+    {
+        std::vector<std::vector<T>> old(buckets.size() * 2);
+        old.swap(buckets);
+        for (long cycle = next; cycle < next + long(old.size()); cycle++)
+            buckets[cycle & (buckets.size() - 1)].swap(old[cycle & (old.size() - 1)]);
+    }
+};
+
+} /* namespace ramulator */
+
+#endif /* __TIMING_WHEEL_H */